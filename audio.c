@@ -5,8 +5,13 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "audio.h"
+#include "filter.h"
+#include "status.h"
+
 #define MIXER_DEV_PATH "/dev/mixer"
 #define MIXER_DEVICE_CLASS "outputs"
 #define MIXER_DEVICE "master"
@@ -14,9 +19,27 @@
 
 #define AUDIO_BUFLEN 8
 
-static int mixer_device, mute_device, initialized = 0;
+/* Key presses closer than this are accelerated (ms) */
+#define AUDIO_REPEAT_INTERVAL 300
+
+/* Volume steps in percent for consecutive auto-repeated key presses */
+static const int audio_steps[] = { 2, 2, 2, 3, 3, 4, 4, 5, 6, 8 };
+
+static int mixer_fd = -1, mixer_device, mute_device, initialized = 0;
+static int muted, left, right, cached = 0;
+
+/* Changes of less than about one percent are not displayed (levels) */
+#define AUDIO_BAND 3
 
-static int audio_print_volume(char *, size_t, int);
+static struct filter left_filter = FILTER_INIT(0.0, AUDIO_BAND, 0.0, 0);
+static struct filter right_filter = FILTER_INIT(0.0, AUDIO_BAND, 0.0, 0);
+static int shown_muted = -1;
+
+static int	audio_read();
+static char    *audio_format();
+static int	audio_gain(int, int);
+static int	audio_print_volume(char *, size_t, int);
+static int	audio_percent(int);
 
 int
 audio_init()
@@ -32,7 +55,7 @@ audio_init()
 	ret = 0;
 	class_index = mixer_device = mute_device = -1;
 
-	fd = open(MIXER_DEV_PATH, O_RDONLY);
+	fd = open(MIXER_DEV_PATH, O_RDWR);
 	if (fd == -1) {
 		warn("cannot open " MIXER_DEV_PATH);
 		goto cleanup_1;
@@ -87,7 +110,8 @@ audio_init()
 		goto cleanup_2;
 	}
 
-	ret = 1;
+	mixer_fd = fd;
+	return 1;
 
 cleanup_2:
 	close(fd);
@@ -99,45 +123,155 @@ cleanup_1:
 char *
 audio_info()
 {
-	static char str[AUDIO_BUFLEN], *res, *strp;
-	int fd, n, muted;
-	size_t buflen;
-	int left, right;
+	if (!audio_read()) {
+		status.audio.valid = 0;
+		return NULL;
+	}
+
+	return audio_format();
+}
+
+/*
+ * Changes the volume by one step up (direction 1) or down (direction -1)
+ * for a volume key press. The steps grow while the key is auto-repeated.
+ */
+char *
+audio_step(int direction)
+{
+	static struct timespec last;
+	static int last_direction = 0, repeat = 0;
+	struct timespec now;
+	long ms;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (now.tv_sec - last.tv_sec) * 1000 +
+	    (now.tv_nsec - last.tv_nsec) / 1000000;
+
+	if (direction == last_direction && ms < AUDIO_REPEAT_INTERVAL) {
+		if (repeat < (int)(sizeof(audio_steps) /
+		    sizeof(audio_steps[0])) - 1)
+			repeat++;
+	} else
+		repeat = 0;
+
+	last = now;
+	last_direction = direction;
+
+	return audio_change_volume(direction * audio_steps[repeat]);
+}
+
+/*
+ * Changes the volume of both channels by delta percent and returns the
+ * new segment string. The new value is computed from the cached mixer
+ * state and published without reading it back from the device.
+ */
+char *
+audio_change_volume(int delta)
+{
 	mixer_ctrl_t value;
 
-	res = NULL;
-	left = right = -1;
+	if (mixer_fd == -1 || (!cached && !audio_read()))
+		return NULL;
 
-	fd = open(MIXER_DEV_PATH, O_RDONLY);
-	if (fd == -1) {
-		warn("cannot open " MIXER_DEV_PATH);
-		goto cleanup_1;
+	value.dev = mixer_device;
+	value.type = AUDIO_MIXER_VALUE;
+	value.un.value.num_channels = 2;
+	value.un.value.level[0] = audio_gain(left, delta);
+	value.un.value.level[1] = audio_gain(right, delta);
+	if (ioctl(mixer_fd, AUDIO_MIXER_WRITE, &value) < 0) {
+		warn("cannot set mixer values");
+		return NULL;
+	}
+	left = value.un.value.level[0];
+	right = value.un.value.level[1];
+
+	/* a requested change is shown however small it is */
+	filter_reset(&left_filter);
+	filter_reset(&right_filter);
+	return audio_format();
+}
+
+char *
+audio_toggle_mute()
+{
+	mixer_ctrl_t value;
+
+	if (mixer_fd == -1 || (!cached && !audio_read()))
+		return NULL;
+
+	value.dev = mute_device;
+	value.type = AUDIO_MIXER_ENUM;
+	value.un.ord = !muted;
+	if (ioctl(mixer_fd, AUDIO_MIXER_WRITE, &value) < 0) {
+		warn("cannot set mixer mute state");
+		return NULL;
 	}
+	muted = value.un.ord;
+
+	return audio_format();
+}
+
+static int
+audio_read()
+{
+	mixer_ctrl_t value;
+
+	cached = 0;
+
+	if (mixer_fd == -1)
+		return 0;
 
 	value.dev = mute_device;
 	value.type = AUDIO_MIXER_ENUM;
-	if (ioctl(fd, AUDIO_MIXER_READ, &value) < 0) {
+	if (ioctl(mixer_fd, AUDIO_MIXER_READ, &value) < 0) {
 		warn("cannot get mixer mute state");
-		goto cleanup_2;
+		return 0;
 	}
 	muted = value.un.ord;
 
-	if (!muted) {
-		value.dev = mixer_device;
-		value.type = AUDIO_MIXER_VALUE;
-		value.un.value.num_channels = 2;
-		if (ioctl(fd, AUDIO_MIXER_READ, &value) < 0) {
-			warn("cannot get mixer values");
-			goto cleanup_2;
-		}
-		left = (int)value.un.value.level[0];
-		right = (int)value.un.value.level[1];
+	value.dev = mixer_device;
+	value.type = AUDIO_MIXER_VALUE;
+	value.un.value.num_channels = 2;
+	if (ioctl(mixer_fd, AUDIO_MIXER_READ, &value) < 0) {
+		warn("cannot get mixer values");
+		return 0;
 	}
+	left = (int)value.un.value.level[0];
+	right = (int)value.un.value.level[1];
+	cached = 1;
+
+	return 1;
+}
+
+/*
+ * Formats the cached mixer state. The string is kept while the filtered
+ * levels and the mute state are unchanged; the status holds the
+ * displayed levels.
+ */
+static char *
+audio_format()
+{
+	static char str[AUDIO_BUFLEN];
+	char *strp;
+	size_t buflen;
+	int n, changed;
+
+	changed = filter_update(&left_filter, left);
+	changed |= filter_update(&right_filter, right);
+
+	status.audio.valid = 1;
+	status.audio.muted = muted;
+	status.audio.left = muted ? 0 : audio_percent((int)left_filter.value);
+	status.audio.right = muted ? 0 : audio_percent((int)right_filter.value);
+	if (!changed && muted == shown_muted)
+		return str;
+	shown_muted = muted;
 
 	strp = str;
 	buflen = sizeof(str);
 
-	n = audio_print_volume(strp, buflen, left);
+	n = audio_print_volume(strp, buflen,
+	    muted ? -1 : (int)left_filter.value);
 	strp += n;
 	buflen -= n;
 
@@ -145,15 +279,21 @@ audio_info()
 	strp += n;
 	buflen -= n;
 
-	n = audio_print_volume(strp, buflen, right);
+	audio_print_volume(strp, buflen, muted ? -1 : (int)right_filter.value);
 
-	res = str;
+	return str;
+}
 
-cleanup_2:
-	close(fd);
+static int
+audio_gain(int level, int delta)
+{
+	level += delta * (AUDIO_MAX_GAIN - AUDIO_MIN_GAIN) / 100;
 
-cleanup_1:
-	return res;
+	if (level < AUDIO_MIN_GAIN)
+		return AUDIO_MIN_GAIN;
+	if (level > AUDIO_MAX_GAIN)
+		return AUDIO_MAX_GAIN;
+	return level;
 }
 
 int
@@ -164,8 +304,12 @@ audio_print_volume(char *str, size_t buflen, int vol)
 	else if (vol >= AUDIO_MAX_GAIN)
 		return strlcpy(str, "M", buflen);
 	else
-		return snprintf(str, buflen, "%d",
-		    (int)(vol / ((AUDIO_MAX_GAIN - AUDIO_MIN_GAIN)
-			/ 100.0)));
+		return snprintf(str, buflen, "%d", audio_percent(vol));
+}
+
+int
+audio_percent(int vol)
+{
+	return (int)(vol / ((AUDIO_MAX_GAIN - AUDIO_MIN_GAIN) / 100.0));
 }
 
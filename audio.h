@@ -2,3 +2,6 @@
 
 char	       *audio_info();
 int		audio_init();
+char	       *audio_change_volume(int);
+char	       *audio_toggle_mute();
+char	       *audio_step(int);
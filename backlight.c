@@ -0,0 +1,105 @@
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <dev/wscons/wsconsio.h>
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "backlight.h"
+#include "filter.h"
+#include "status.h"
+
+#define BACKLIGHT_DEVICE "/dev/ttyC0"
+#define BACKLIGHT_BUFLEN 5
+
+static int backlight_fd = -1, initialized = 0;
+
+/* Only read by the brightness job, a change below one percent is noise */
+static struct filter brightness_filter = FILTER_INIT(1.0, 1.0, 0.0, 0);
+
+static int	backlight_get(struct wsdisplay_param *);
+
+/*
+ * Fallback for displays without a RandR backlight property. The
+ * brightness is read from the console driver, like wsconsctl(8) does.
+ * The device can be overridden with BACKLIGHT_DEVICE. Returns 1 if the
+ * driver supports brightness control.
+ */
+int
+backlight_init()
+{
+	struct wsdisplay_param dp;
+	char *path;
+
+	if (initialized)
+		errx(1, "backlight_init called twice");
+
+	initialized = 1;
+
+	if ((path = getenv("BACKLIGHT_DEVICE")) == NULL)
+		path = BACKLIGHT_DEVICE;
+
+	if ((backlight_fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+		warn("cannot open %s", path);
+		return 0;
+	}
+
+	if (!backlight_get(&dp)) {
+		close(backlight_fd);
+		backlight_fd = -1;
+		return 0;
+	}
+
+	return 1;
+}
+
+char *
+backlight_info()
+{
+	static char str[BACKLIGHT_BUFLEN];
+
+	return backlight_read(str, sizeof(str), &status.brightness) ?
+	    str : NULL;
+}
+
+/*
+ * Fetches the brightness into str and st, which may be a copy of the
+ * status member. Returns 1 on success.
+ */
+int
+backlight_read(char *str, size_t len, void *arg)
+{
+	struct status_brightness *st = arg;
+	struct wsdisplay_param dp;
+	double percent;
+
+	st->valid = 0;
+
+	if (backlight_fd == -1 || !backlight_get(&dp))
+		return 0;
+
+	st->valid = 1;
+	percent = (dp.curval - dp.min) * 100.0 / (dp.max - dp.min);
+	filter_update(&brightness_filter, percent);
+	st->percent = brightness_filter.value;
+	snprintf(str, len, "%.0f%%", brightness_filter.value);
+	return 1;
+}
+
+static int
+backlight_get(struct wsdisplay_param *dp)
+{
+	dp->param = WSDISPLAYIO_PARAM_BRIGHTNESS;
+	if (ioctl(backlight_fd, WSDISPLAYIO_GETPARAM, dp) == -1) {
+		warn("cannot get display brightness");
+		return 0;
+	}
+	if (dp->max <= dp->min) {
+		warnx("invalid display brightness range");
+		return 0;
+	}
+
+	return 1;
+}
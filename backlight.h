@@ -0,0 +1,5 @@
+#define BACKLIGHT_INTERVAL (2 * 1000)
+
+int     backlight_init();
+char   *backlight_info();
+int     backlight_read(char *, size_t, void *);
@@ -1,16 +1,53 @@
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/sensors.h>
+#include <sys/sysctl.h>
 #include <machine/apmvar.h>
 #include <fcntl.h>
 #include <err.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
 
+#include "battery.h"
+#include "filter.h"
+#include "health.h"
+#include "status.h"
+
 #define BATT_INFO_BUFLEN 13
 #define APM_DEV_PATH "/dev/apm"
 
+/* Sensor devices of the batteries, e.g. acpibat0 */
+#define BATT_DEVICE "acpibat"
+#define BATT_REMAINING 3	/* index of the remaining capacity sensor */
+
+#define BATT_TAU 300.0		/* s, time constant of the drain average */
+#define BATT_FINE_STEP 5	/* displayed minutes below an hour */
+#define BATT_COARSE_STEP 15	/* displayed minutes above */
+#define BATT_MAX_MINUTES (99 * 60)
+
+static int charge_mib[5] = { CTL_HW, HW_SENSORS, -1, SENSOR_WATTHOUR,
+    BATT_REMAINING };
+static int looked_up = 0;
+
+/*
+ * The drain since the battery was unplugged. The driver's minutes_left
+ * only seeds the rate, it jumps by far too much between samples.
+ */
+static struct {
+	int		 discharging;
+	long long	 time;		/* ms, of the last charge change */
+	double		 charge;	/* µWh, µAh or percent */
+	double		 rate;		/* charge per s, 0 if unknown */
+	int		 minutes;	/* displayed, -1 if unknown */
+} estimate = { 0, 0, 0.0, 0.0, -1 };
+
+static void	battery_lookup();
+static double	battery_charge(const struct apm_power_info *);
+static int	battery_estimate(const struct apm_power_info *);
+
 char *
 battery_info()
 {
@@ -18,9 +55,12 @@ battery_info()
 	static char str[BATT_INFO_BUFLEN];
 	int minutes, n, fd, state;
 
+	status.battery.valid = 0;
+
 	fd = open(APM_DEV_PATH, O_RDONLY);
 	if (fd == -1) {
-		warn("cannot open " APM_DEV_PATH);
+		health_warn(HEALTH_BATTERY, "cannot open " APM_DEV_PATH);
+		health_fail(HEALTH_BATTERY);
 		return NULL;
 	}
 
@@ -28,15 +68,21 @@ battery_info()
 	close(fd);
 
 	if (state < 0) {
-		warn("cannot read battery info");
+		health_warn(HEALTH_BATTERY, "cannot read battery info");
+		health_fail(HEALTH_BATTERY);
 		return NULL;
 	}
 
 	n = -1;
+	status.battery.ac = info.ac_state == APM_AC_ON;
+	status.battery.percent = info.battery_life;
+	status.battery.minutes = -1;
+
 	switch (info.ac_state) {
 
 	case APM_AC_OFF:
-	        minutes = info.minutes_left;
+		minutes = battery_estimate(&info);
+		status.battery.minutes = minutes;
 		if (minutes < 0)
 			n = strlcpy(str, "--:--", BATT_INFO_BUFLEN);
 		else
@@ -45,15 +91,131 @@ battery_info()
 		/* FALLTHROUGH */
 
 	case APM_AC_ON:
+		if (info.ac_state == APM_AC_ON)
+			estimate.discharging = 0;
 		if (n < 0)
 			n = strlcpy(str, "A/C", BATT_INFO_BUFLEN);
 
 		snprintf(str + n, BATT_INFO_BUFLEN - n, " (%d%%)",
 		    info.battery_life);
+		status.battery.valid = 1;
+		health_ok(HEALTH_BATTERY);
 		return str;
 		break;
 
 	default:
+		/* no battery, e.g. on a desktop */
+		health_fail(HEALTH_BATTERY);
 		return NULL;
 	}
 }
+
+/*
+ * Looks up the remaining capacity of the first battery once, in Wh or
+ * Ah depending on the battery. Without one the percentage is used.
+ */
+static void
+battery_lookup()
+{
+	struct sensordev sd;
+	size_t len;
+	int mib[3] = { CTL_HW, HW_SENSORS, 0 };
+
+	looked_up = 1;
+
+	for (mib[2] = 0; ; mib[2]++) {
+		len = sizeof(sd);
+		if (sysctl(mib, 3, &sd, &len, NULL, 0) == -1) {
+			if (errno == ENXIO)
+				continue;
+			if (errno != ENOENT)
+				warn("cannot get sensor device");
+			return;
+		}
+		if (strncmp(sd.xname, BATT_DEVICE, strlen(BATT_DEVICE)) != 0)
+			continue;
+		if (sd.maxnumt[SENSOR_WATTHOUR] > BATT_REMAINING)
+			charge_mib[3] = SENSOR_WATTHOUR;
+		else if (sd.maxnumt[SENSOR_AMPHOUR] > BATT_REMAINING)
+			charge_mib[3] = SENSOR_AMPHOUR;
+		else
+			continue;
+		charge_mib[2] = sd.num;
+		return;
+	}
+}
+
+static double
+battery_charge(const struct apm_power_info *info)
+{
+	struct sensor sensor;
+	size_t len;
+
+	if (!looked_up)
+		battery_lookup();
+
+	if (charge_mib[2] != -1) {
+		len = sizeof(sensor);
+		if (sysctl(charge_mib, 5, &sensor, &len, NULL, 0) == 0 &&
+		    !(sensor.flags & SENSOR_FINVALID))
+			return sensor.value;
+		warnx("cannot read battery capacity, using the percentage");
+		charge_mib[2] = -1;
+		/* another unit, start over */
+		estimate.discharging = 0;
+	}
+
+	return info->battery_life;
+}
+
+/*
+ * Returns the displayed minutes left, or -1. The drain rate is an
+ * exponentially weighted average over the charge changes, weighted by
+ * the time between them as the charge is counted in coarse steps. The
+ * displayed value is quantized and only moves once the estimate has
+ * moved by a whole step, so the string changes rarely.
+ */
+static int
+battery_estimate(const struct apm_power_info *info)
+{
+	long long now;
+	double charge, dt, drain, minutes;
+	int step;
+
+	now = filter_now();
+	charge = battery_charge(info);
+
+	if (!estimate.discharging || charge > estimate.charge) {
+		/* just unplugged or recalibrated */
+		estimate.discharging = 1;
+		estimate.time = now;
+		estimate.charge = charge;
+		estimate.rate = info->minutes_left > 0 ?
+		    charge / (info->minutes_left * 60.0) : 0.0;
+		estimate.minutes = -1;
+	} else if (charge < estimate.charge) {
+		dt = (now - estimate.time) / 1000.0;
+		drain = (estimate.charge - charge) / (dt > 1.0 ? dt : 1.0);
+		if (estimate.rate > 0.0)
+			estimate.rate += dt / (BATT_TAU + dt) *
+			    (drain - estimate.rate);
+		else
+			estimate.rate = drain;
+		estimate.time = now;
+		estimate.charge = charge;
+	}
+
+	if (estimate.rate <= 0.0)
+		return estimate.minutes = -1;
+
+	minutes = charge / estimate.rate / 60.0;
+	if (minutes > BATT_MAX_MINUTES)
+		minutes = BATT_MAX_MINUTES;
+
+	step = minutes < 60.0 ? BATT_FINE_STEP : BATT_COARSE_STEP;
+	if (estimate.minutes < 0 || minutes <= estimate.minutes - step ||
+	    minutes >= estimate.minutes + step)
+		estimate.minutes = (int)(minutes / step + 0.5) * step;
+
+	return estimate.minutes;
+}
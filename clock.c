@@ -2,6 +2,8 @@
 #include <time.h>
 #include <err.h>
 
+#include "status.h"
+
 #define CLOCK_FORMAT "%a %b %d, %R"
 #define CLOCK_BUFLEN 18
 
@@ -12,6 +14,8 @@ clock_info(int *next_update)
 	struct tm ltime;
 	time_t clock;
 
+	status.clock.valid = 0;
+
 	if (next_update)
 	    *next_update = 10 * 1000;
 
@@ -30,6 +34,9 @@ clock_info(int *next_update)
 
 	strftime(str, sizeof(str), CLOCK_FORMAT, &ltime);
 
+	status.clock.valid = 1;
+	status.clock.time = clock;
+
 	return str;
 }
 
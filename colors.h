@@ -1,3 +1,4 @@
 #define NORMAL_COLOR "%{F#DDDDDD}"
 #define SEPARATOR_COLOR "%{F#888888}"
 #define MAIL_COLOR "%{F#FFFF00}"
+#define WARNING_COLOR "%{F#FF4444}"
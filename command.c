@@ -0,0 +1,213 @@
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <json-c/json.h>
+
+#include "audio.h"
+#include "command.h"
+#include "mpd.h"
+#include "status.h"
+
+#define COMMAND_BUFLEN 512	/* fits an i3bar click event */
+#define VOLUME_STEP 5
+
+struct mpd_command {
+	const char	*name;
+	const char	*cmd;
+};
+
+static const struct mpd_command mpd_commands[] = {
+	{ "toggle",	"pause\n" },
+	{ "play",	"play\n" },
+	{ "pause",	"pause 1\n" },
+	{ "stop",	"stop\n" },
+	{ "next",	"next\n" },
+	{ "previous",	"previous\n" },
+	{ NULL,		NULL }
+};
+
+/* Click events of the i3bar protocol, the same as the lemonbar areas */
+struct click {
+	int		 info;
+	int		 button;
+	const char	*command;
+};
+
+static const struct click clicks[] = {
+	{ INFO_MPD,	1,	"mpd toggle" },
+	{ INFO_MPD,	3,	"mpd next" },
+	{ INFO_AUDIO,	1,	"volume mute" },
+	{ INFO_AUDIO,	4,	"volume up" },
+	{ INFO_AUDIO,	5,	"volume down" },
+	{ -1,		0,	NULL }
+};
+
+static char buf[COMMAND_BUFLEN];
+static size_t buflen = 0;
+static int json_clicks = 0;
+
+static void	command_click(char *, int *, char **);
+static void	command_execute(char *, int *, char **);
+
+/*
+ * Commands are read from standard input, so the click actions printed
+ * by lemonbar can be fed back to this program through a FIFO:
+ *
+ *	mkfifo cmd; lemonbar-status < cmd | lemonbar > cmd
+ *
+ * With i3bar set, the input is the stream of click events of the
+ * i3bar protocol instead. Returns the descriptor to watch or -1 if
+ * standard input is a terminal.
+ */
+int
+command_init(int i3bar)
+{
+	if (isatty(STDIN_FILENO))
+		return -1;
+
+	json_clicks = i3bar;
+
+	if (fcntl(STDIN_FILENO, F_SETFL, O_NONBLOCK) == -1) {
+		warn("cannot make standard input non-blocking");
+		return -1;
+	}
+
+	return STDIN_FILENO;
+}
+
+/*
+ * Executes all complete command lines available on fd. The affected
+ * elements of infos are refreshed immediately. If the MPD connection
+ * fails, it is closed and *mpd_fd is set to -1. Returns -1 at end of
+ * file.
+ */
+int
+command_read(int fd, int *mpd_fd, char *infos[])
+{
+	char *line, *nl;
+	ssize_t n;
+
+	n = read(fd, buf + buflen, sizeof(buf) - buflen - 1);
+	if (n == -1)
+		return errno == EAGAIN ? 0 : -1;
+	if (n == 0)
+		return -1;
+	buflen += n;
+	buf[buflen] = '\0';
+
+	line = buf;
+	while ((nl = strchr(line, '\n')) != NULL) {
+		*nl = '\0';
+		if (json_clicks)
+			command_click(line, mpd_fd, infos);
+		else
+			command_execute(line, mpd_fd, infos);
+		line = nl + 1;
+	}
+
+	buflen -= line - buf;
+	memmove(buf, line, buflen);
+
+	if (buflen == sizeof(buf) - 1) {
+		warnx("command too long");
+		buflen = 0;
+	}
+
+	return 0;
+}
+
+/*
+ * Executes the command bound to a click event. The events are elements
+ * of an infinite array, so the opening bracket and separating commas
+ * are skipped.
+ */
+static void
+command_click(char *line, int *mpd_fd, char *infos[])
+{
+	struct json_object *obj, *name, *button;
+	const struct click *c;
+	char command[COMMAND_BUFLEN];
+	int info;
+
+	line += strspn(line, " \t[,");
+	if (*line == '\0')
+		return;
+
+	if ((obj = json_tokener_parse(line)) == NULL) {
+		warnx("invalid click event");
+		return;
+	}
+	if (!json_object_object_get_ex(obj, "name", &name) ||
+	    !json_object_object_get_ex(obj, "button", &button)) {
+		warnx("incomplete click event");
+		goto cleanup;
+	}
+
+	info = status_element(json_object_get_string(name));
+	for (c = clicks; c->command != NULL; c++)
+		if (c->info == info &&
+		    c->button == json_object_get_int(button))
+			break;
+	if (c->command != NULL) {
+		strlcpy(command, c->command, sizeof(command));
+		command_execute(command, mpd_fd, infos);
+	}
+
+cleanup:
+	json_object_put(obj);
+}
+
+static void
+command_execute(char *line, int *mpd_fd, char *infos[])
+{
+	const struct mpd_command *mc;
+	char *arg, *ep;
+	long delta;
+
+	if ((arg = strchr(line, ' ')) != NULL)
+		*arg++ = '\0';
+
+	if (strcmp(line, "mpd") == 0 && arg != NULL) {
+		for (mc = mpd_commands; mc->name != NULL; mc++)
+			if (strcmp(arg, mc->name) == 0)
+				break;
+		if (mc->name == NULL) {
+			warnx("unknown mpd command: %s", arg);
+			return;
+		}
+		if (*mpd_fd < 0) {
+			warnx("mpd is not connected");
+			return;
+		}
+		if (mpd_command(*mpd_fd, mc->cmd) == -1 ||
+		    (infos[INFO_MPD] = mpd_info(*mpd_fd)) == NULL) {
+			infos[INFO_MPD] = NULL;
+			mpd_close(*mpd_fd);
+			*mpd_fd = -1;
+			return;
+		}
+		mpd_idle_start(*mpd_fd);
+	} else if (strcmp(line, "volume") == 0 && arg != NULL) {
+		if (strcmp(arg, "mute") == 0) {
+			infos[INFO_AUDIO] = audio_toggle_mute();
+			return;
+		}
+		if (strcmp(arg, "up") == 0)
+			delta = VOLUME_STEP;
+		else if (strcmp(arg, "down") == 0)
+			delta = -VOLUME_STEP;
+		else {
+			delta = strtol(arg, &ep, 10);
+			if (*arg == '\0' || *ep != '\0' || delta < -100 ||
+			    delta > 100) {
+				warnx("invalid volume change: %s", arg);
+				return;
+			}
+		}
+		infos[INFO_AUDIO] = audio_change_volume(delta);
+	} else
+		warnx("unknown command: %s", line);
+}
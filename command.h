@@ -0,0 +1,2 @@
+int     command_init(int);
+int     command_read(int, int *, char **);
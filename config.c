@@ -0,0 +1,424 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "audio.h"
+#include "battery.h"
+#include "config.h"
+#include "net.h"
+#include "netrate.h"
+#include "status.h"
+#include "system.h"
+#include "weather.h"
+#include "x.h"
+
+#define CONFIG_LINELEN 512
+#define CONFIG_WORDS (INFO_ARRAY_SIZE + 2)	/* a layout and one more */
+
+/*
+ * The values which were compiled in before, used for missing keys. The
+ * weather directory is set below $HOME by config_init().
+ */
+static struct config defaults = {
+	.order = { INFO_WINDOW, INFO_MPD, INFO_MAIL, INFO_SCRIPTS, INFO_LOAD,
+	    INFO_CPU, INFO_MEMORY, INFO_NETWORK, INFO_NETRATE, INFO_BATTERY,
+	    INFO_FS, INFO_THERMAL, INFO_KEYBOARD, INFO_BRIGHTNESS, INFO_AUDIO,
+	    INFO_WEATHER, INFO_CLOCK },
+	.norder = INFO_ARRAY_SIZE,
+	.nleft = INFO_MPD + 1,
+	.intervals = {
+		[INTERVAL_BATTERY] = BATTERY_INTERVAL,
+		[INTERVAL_NET] = NET_INTERVAL,
+		[INTERVAL_AUDIO] = AUDIO_INTERVAL,
+		[INTERVAL_BRIGHTNESS] = BRIGHTNESS_INTERVAL,
+		[INTERVAL_SYSTEM] = SYSTEM_INTERVAL,
+		[INTERVAL_WEATHER] = WEATHER_INTERVAL,
+		[INTERVAL_NETRATE] = NETRATE_INTERVAL
+	},
+	.interface = "trunk0",
+	.output = "eDP1",
+	.keys = { [KEY_MUTE] = 160, [KEY_DOWN] = 174, [KEY_UP] = 176 },
+	.mpd_host = "localhost",
+	.mpd_port = "6600"
+};
+
+static const char *interval_names[INTERVAL_ARRAY_SIZE] = {
+	[INTERVAL_BATTERY] = "battery",
+	[INTERVAL_NET] = "network",
+	[INTERVAL_AUDIO] = "audio",
+	[INTERVAL_BRIGHTNESS] = "brightness",
+	[INTERVAL_SYSTEM] = "system",
+	[INTERVAL_WEATHER] = "weather",
+	[INTERVAL_NETRATE] = "throughput"
+};
+
+const struct config *_Atomic config = &defaults;
+
+static char path[PATH_MAX];
+static int initialized = 0;
+
+/* The elements of the "left" and "right" lines, -1 if not given */
+struct config_layout {
+	unsigned char	left[INFO_ARRAY_SIZE];
+	unsigned char	right[INFO_ARRAY_SIZE];
+	int		nleft;
+	int		nright;
+};
+
+static struct config *config_parse(FILE *);
+static const char *config_line(char **, int, struct config *,
+		    struct config_layout *);
+static const char *config_elements(char **, int, unsigned char *, int *);
+static const char *config_script(char **, int, struct config *);
+static const char *config_string(const char *, char *, size_t);
+static int	config_number(const char *, int, int, int *);
+static int	config_diff(const struct config *, const struct config *);
+
+/*
+ * Loads the configuration file below $HOME, if there is one. Returns
+ * the descriptor of the file to be watched or -1; *dir_fd is set to its
+ * directory, which shows a file replaced by a rename or created later.
+ */
+int
+config_init(int *dir_fd)
+{
+	char dir[PATH_MAX], *home, *slash;
+	int fd;
+
+	if (initialized)
+		errx(1, "config_init called twice");
+
+	initialized = 1;
+	*dir_fd = -1;
+
+	if ((home = getenv("HOME")) == NULL) {
+		warnx("HOME is not set");
+		return -1;
+	}
+	snprintf(defaults.weather, sizeof(defaults.weather),
+	    "%s" CONFIG_WEATHER_PATH, home);
+	snprintf(path, sizeof(path), "%s" CONFIG_PATH, home);
+
+	strlcpy(dir, path, sizeof(dir));
+	slash = strrchr(dir, '/');
+	*slash = '\0';
+	*dir_fd = open(dir, O_RDONLY | O_DIRECTORY);
+
+	fd = -1;
+	config_reload(&fd);
+	return fd;
+}
+
+/*
+ * Parses the configuration file again, opening it again if it has been
+ * replaced, and publishes the new layout. An invalid file is reported
+ * and the previous layout kept. Returns the changed parts as a set of
+ * CONFIG_* bits.
+ */
+int
+config_reload(int *fd)
+{
+	struct config *new;
+	struct stat sb, fsb;
+	FILE *fp;
+	int changes;
+
+	if (path[0] == '\0')
+		return 0;
+
+	if (stat(path, &sb) == -1) {
+		if (errno != ENOENT)
+			warn("cannot stat %s", path);
+		if (*fd >= 0) {
+			close(*fd);
+			*fd = -1;
+		}
+		return 0;
+	}
+
+	if (*fd >= 0 && (fstat(*fd, &fsb) == -1 || sb.st_dev != fsb.st_dev ||
+	    sb.st_ino != fsb.st_ino)) {
+		close(*fd);
+		*fd = -1;
+	}
+	if (*fd == -1 && (*fd = open(path, O_RDONLY)) == -1) {
+		warn("cannot open %s", path);
+		return 0;
+	}
+
+	/* the watched descriptor is only used for the events */
+	if ((fp = fopen(path, "r")) == NULL) {
+		warn("cannot open %s", path);
+		return 0;
+	}
+	new = config_parse(fp);
+	fclose(fp);
+
+	if (new == NULL)
+		return 0;
+
+	if ((changes = config_diff(config, new)) == 0) {
+		free(new);
+		return 0;
+	}
+
+	atomic_store_explicit(&config, new, memory_order_release);
+	return changes;
+}
+
+/*
+ * Reads the lines "key value ...", comments start with '#'. Keys which
+ * are not given keep their defaults. Returns NULL if the file is
+ * invalid.
+ */
+static struct config *
+config_parse(FILE *fp)
+{
+	struct config *new;
+	struct config_layout layout;
+	char line[CONFIG_LINELEN], *words[CONFIG_WORDS], *p;
+	const char *error;
+	int lineno, nwords, i;
+
+	if ((new = malloc(sizeof(*new))) == NULL) {
+		warn("cannot parse %s", path);
+		return NULL;
+	}
+	memcpy(new, &defaults, sizeof(*new));
+	layout.nleft = layout.nright = -1;
+
+	for (lineno = 1; fgets(line, sizeof(line), fp) != NULL; lineno++) {
+		error = NULL;
+		if (strchr(line, '\n') == NULL && !feof(fp))
+			error = "line too long";
+
+		if ((p = strchr(line, '#')) != NULL)
+			*p = '\0';
+		p = line;
+		nwords = 0;
+		while (error == NULL &&
+		    (words[nwords] = strsep(&p, " \t\n")) != NULL) {
+			if (*words[nwords] == '\0')
+				continue;
+			if (++nwords == CONFIG_WORDS)
+				error = "too many values";
+		}
+
+		if (error == NULL && nwords > 0)
+			error = config_line(words, nwords, new, &layout);
+		if (error != NULL) {
+			warnx("%s:%d: %s", path, lineno, error);
+			goto fail;
+		}
+	}
+	if (ferror(fp)) {
+		warn("cannot read %s", path);
+		goto fail;
+	}
+
+	/* the right aligned elements follow the left aligned ones */
+	if (layout.nleft >= 0 || layout.nright >= 0) {
+		new->nleft = layout.nleft > 0 ? layout.nleft : 0;
+		new->norder = new->nleft;
+		memcpy(new->order, layout.left, new->nleft);
+		for (i = 0; i < layout.nright; i++) {
+			if (memchr(new->order, layout.right[i], new->nleft)
+			    != NULL) {
+				warnx("%s: %s is left and right aligned",
+				    path, status_names[layout.right[i]]);
+				goto fail;
+			}
+			new->order[new->norder++] = layout.right[i];
+		}
+	}
+
+	return new;
+
+fail:
+	free(new);
+	return NULL;
+}
+
+/* Applies the words of one line to new. Returns an error or NULL. */
+static const char *
+config_line(char *words[], int nwords, struct config *new,
+    struct config_layout *layout)
+{
+	const char *key = words[0];
+	int i;
+
+	if (strcmp(key, "left") == 0)
+		return config_elements(words + 1, nwords - 1, layout->left,
+		    &layout->nleft);
+	if (strcmp(key, "right") == 0)
+		return config_elements(words + 1, nwords - 1, layout->right,
+		    &layout->nright);
+
+	if (strcmp(key, "interval") == 0) {
+		if (nwords != 3)
+			return "interval needs a source and seconds";
+		for (i = 0; i < INTERVAL_ARRAY_SIZE; i++)
+			if (strcmp(words[1], interval_names[i]) == 0)
+				break;
+		if (i == INTERVAL_ARRAY_SIZE)
+			return "unknown interval";
+		if (!config_number(words[2], 1, 3600, &new->intervals[i]))
+			return "interval must be 1 to 3600 seconds";
+		new->intervals[i] *= 1000;
+		return NULL;
+	}
+
+	if (strcmp(key, "keys") == 0) {
+		if (nwords != KEY_ARRAY_SIZE + 1)
+			return "keys needs three keycodes";
+		for (i = 0; i < KEY_ARRAY_SIZE; i++)
+			if (!config_number(words[i + 1], 8, 255,
+			    &new->keys[i]))
+				return "keycodes must be 8 to 255";
+		return NULL;
+	}
+
+	if (strcmp(key, "script") == 0)
+		return config_script(words + 1, nwords - 1, new);
+
+	if (strcmp(key, "mpd") == 0) {
+		if (nwords != 2 && nwords != 3)
+			return "mpd needs a host and an optional port";
+		if (nwords == 3 && config_string(words[2], new->mpd_port,
+		    sizeof(new->mpd_port)) != NULL)
+			return "port too long";
+		return config_string(words[1], new->mpd_host,
+		    sizeof(new->mpd_host));
+	}
+
+	if (nwords != 2)
+		return "exactly one value expected";
+	if (strcmp(key, "interface") == 0)
+		return config_string(words[1], new->interface,
+		    sizeof(new->interface));
+	if (strcmp(key, "output") == 0)
+		return config_string(words[1], new->output,
+		    sizeof(new->output));
+	if (strcmp(key, "weather") == 0)
+		return config_string(words[1], new->weather,
+		    sizeof(new->weather));
+	if (strcmp(key, "weather_url") == 0)
+		return config_string(words[1], new->weather_url,
+		    sizeof(new->weather_url));
+
+	return "unknown key";
+}
+
+/* Appends the elements named by words to order. */
+static const char *
+config_elements(char *words[], int nwords, unsigned char *order,
+    int *norder)
+{
+	int i, info;
+
+	if (*norder < 0)
+		*norder = 0;
+	for (i = 0; i < nwords; i++) {
+		if ((info = status_element(words[i])) == -1)
+			return "unknown element";
+		if (memchr(order, info, *norder) != NULL)
+			return "element listed twice";
+		order[(*norder)++] = info;
+	}
+
+	return NULL;
+}
+
+/* Appends the command "interval timeout command [argument ...]". */
+static const char *
+config_script(char *words[], int nwords, struct config *new)
+{
+	struct config_script *s;
+	int i;
+
+	if (nwords < 3)
+		return "script needs an interval, a timeout and a command";
+	if (nwords - 2 > CONFIG_SCRIPT_ARGS)
+		return "too many arguments";
+	if (new->nscripts == CONFIG_MAX_SCRIPTS)
+		return "too many scripts";
+
+	s = &new->scripts[new->nscripts];
+	if (!config_number(words[0], 1, 86400, &s->interval))
+		return "script interval must be 1 to 86400 seconds";
+	if (!config_number(words[1], 1, 3600, &s->timeout))
+		return "script timeout must be 1 to 3600 seconds";
+	s->interval *= 1000;
+	s->timeout *= 1000;
+
+	for (i = 2; i < nwords; i++) {
+		if (i > 2)
+			strlcat(s->command, " ", sizeof(s->command));
+		if (strlcat(s->command, words[i], sizeof(s->command)) >=
+		    sizeof(s->command))
+			return "command too long";
+	}
+	new->nscripts++;
+
+	return NULL;
+}
+
+static const char *
+config_string(const char *str, char *dst, size_t size)
+{
+	if (strlcpy(dst, str, size) >= size)
+		return "value too long";
+
+	return NULL;
+}
+
+static int
+config_number(const char *str, int min, int max, int *res)
+{
+	char *ep;
+	long l;
+
+	l = strtol(str, &ep, 10);
+	if (*str == '\0' || *ep != '\0' || l < min || l > max)
+		return 0;
+
+	*res = l;
+	return 1;
+}
+
+/* Returns the CONFIG_* bits of the parts which differ. */
+static int
+config_diff(const struct config *old, const struct config *new)
+{
+	int changes = 0;
+
+	if (old->norder != new->norder || old->nleft != new->nleft ||
+	    memcmp(old->order, new->order, new->norder) != 0)
+		changes |= CONFIG_LAYOUT;
+	if (memcmp(old->intervals, new->intervals, sizeof(new->intervals))
+	    != 0)
+		changes |= CONFIG_INTERVALS;
+	if (strcmp(old->interface, new->interface) != 0)
+		changes |= CONFIG_NET;
+	if (strcmp(old->output, new->output) != 0)
+		changes |= CONFIG_OUTPUT;
+	if (memcmp(old->keys, new->keys, sizeof(new->keys)) != 0)
+		changes |= CONFIG_KEYS;
+	if (strcmp(old->weather, new->weather) != 0 ||
+	    strcmp(old->weather_url, new->weather_url) != 0)
+		changes |= CONFIG_WEATHER;
+	if (strcmp(old->mpd_host, new->mpd_host) != 0 ||
+	    strcmp(old->mpd_port, new->mpd_port) != 0)
+		changes |= CONFIG_MPD;
+	if (old->nscripts != new->nscripts ||
+	    memcmp(old->scripts, new->scripts, sizeof(new->scripts)) != 0)
+		changes |= CONFIG_SCRIPTS;
+
+	return changes;
+}
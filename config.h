@@ -0,0 +1,72 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <sys/types.h>
+#include <net/if.h>
+#include <limits.h>
+#include <stdatomic.h>
+
+#include "status.h"
+
+#define CONFIG_PATH "/.config/lemonbar-status/config"	/* below $HOME */
+#define CONFIG_WEATHER_PATH "/.cache/weather"	/* below $HOME */
+#define CONFIG_STRLEN 64
+#define CONFIG_URLLEN 256
+#define CONFIG_MAX_SCRIPTS 4
+#define CONFIG_SCRIPT_ARGS 8	/* words of a script command */
+
+/* Parts of the configuration, reported by config_reload() if changed */
+#define CONFIG_LAYOUT 0x01
+#define CONFIG_INTERVALS 0x02
+#define CONFIG_NET 0x04
+#define CONFIG_OUTPUT 0x08
+#define CONFIG_KEYS 0x10
+#define CONFIG_WEATHER 0x20
+#define CONFIG_MPD 0x40
+#define CONFIG_SCRIPTS 0x80
+
+enum config_intervals { INTERVAL_BATTERY, INTERVAL_NET, INTERVAL_AUDIO,
+    INTERVAL_BRIGHTNESS, INTERVAL_SYSTEM, INTERVAL_WEATHER, INTERVAL_NETRATE,
+    INTERVAL_ARRAY_SIZE };
+
+enum config_keys { KEY_MUTE, KEY_DOWN, KEY_UP, KEY_ARRAY_SIZE };
+
+/* A command whose first output line is displayed */
+struct config_script {
+	int		interval;		/* ms */
+	int		timeout;		/* ms */
+	char		command[CONFIG_URLLEN];	/* words separated by spaces */
+};
+
+/*
+ * The parsed configuration file. A layout is never changed or freed
+ * once it is published, as worker threads may still be reading the
+ * previous one; a reload publishes a new one instead.
+ */
+struct config {
+	unsigned char	order[INFO_ARRAY_SIZE];	/* displayed elements */
+	int		norder;
+	int		nleft;			/* left aligned of them */
+	int		intervals[INTERVAL_ARRAY_SIZE];	/* ms */
+	char		interface[IFNAMSIZ];
+	char		output[CONFIG_STRLEN];	/* RandR output */
+	int		keys[KEY_ARRAY_SIZE];	/* keycodes */
+	char		weather[PATH_MAX];	/* directory */
+	char		weather_url[CONFIG_URLLEN];	/* fetched if set */
+	char		mpd_host[CONFIG_STRLEN];
+	char		mpd_port[CONFIG_STRLEN];
+	struct config_script scripts[CONFIG_MAX_SCRIPTS];
+	int		nscripts;
+};
+
+/*
+ * Only replaced by config_reload() on the main thread, with release
+ * order. Worker threads load it once with acquire order, so they see a
+ * complete configuration and keep using the same one.
+ */
+extern const struct config *_Atomic config;
+
+int	config_init(int *);
+int	config_reload(int *);
+
+#endif /* CONFIG_H */
@@ -0,0 +1,80 @@
+#include <time.h>
+
+#include "filter.h"
+
+/*
+ * Passes a sample of a numeric source through f before it is formatted.
+ * The displayed value, f->value, is the sample rounded to a multiple of
+ * the step. It only changes once a sample is outside the hysteresis
+ * band around it, the larger of the absolute and the relative band, and
+ * has been displayed for the hold time. A change during the hold is
+ * kept pending, see filter_wait(). Returns 1 if the value has changed,
+ * i.e. if the string has to be formatted again.
+ */
+int
+filter_update(struct filter *f, double sample)
+{
+	double value, band;
+	long long now;
+
+	value = sample;
+	if (f->step > 0.0)
+		value = (long long)(sample / f->step +
+		    (sample < 0.0 ? -0.5 : 0.5)) * f->step;
+
+	now = filter_now();
+
+	if (f->valid) {
+		f->pending = 0;
+		if (value == f->value)
+			return 0;
+		band = f->ratio * (f->value < 0.0 ? -f->value : f->value);
+		if (band < f->band)
+			band = f->band;
+		if (sample > f->value - band && sample < f->value + band)
+			return 0;
+		if (now - f->time < f->hold) {
+			f->pending = 1;
+			return 0;
+		}
+	}
+
+	f->valid = 1;
+	f->value = value;
+	f->time = now;
+	return 1;
+}
+
+/*
+ * Returns the ms until the hold of a pending change is over, when the
+ * source has to be sampled again, or -1 if no change is pending.
+ */
+int
+filter_wait(const struct filter *f)
+{
+	long long wait;
+
+	if (!f->valid || !f->pending)
+		return -1;
+
+	wait = f->hold - (filter_now() - f->time);
+	return wait > 1 ? wait : 1;
+}
+
+/* Lets the next sample through, e.g. after the source has changed. */
+void
+filter_reset(struct filter *f)
+{
+	f->valid = 0;
+	f->pending = 0;
+}
+
+/* Returns the CLOCK_MONOTONIC time in ms, for holds and deadlines. */
+long long
+filter_now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
@@ -0,0 +1,19 @@
+/* Parameters of a filter, see filter_update() */
+#define FILTER_INIT(step, band, ratio, hold) \
+	{ (step), (band), (ratio), (hold), 0, 0, 0.0, 0 }
+
+struct filter {
+	double		step;	/* displayed values are multiples, or 0 */
+	double		band;	/* distance a sample must move away */
+	double		ratio;	/* the same relative to the displayed value */
+	int		hold;	/* ms a displayed value is kept at least */
+	int		valid;
+	int		pending;	/* a change waits for the hold */
+	double		value;	/* displayed */
+	long long	time;	/* ms it was published */
+};
+
+int     filter_update(struct filter *, double);
+int     filter_wait(const struct filter *);
+void    filter_reset(struct filter *);
+long long filter_now();
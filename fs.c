@@ -0,0 +1,130 @@
+#include <sys/types.h>
+#include <sys/mount.h>
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "colors.h"
+#include "filter.h"
+#include "fs.h"
+#include "status.h"
+
+#define FS_BUFLEN 128
+
+#define FS_INTERVAL (300 * 1000)	/* statfs refresh */
+#define FS_FULL_INTERVAL (30 * 1000)	/* statfs refresh when nearly full */
+#define FS_MOUNT_INTERVAL (10 * 1000)	/* mount table check */
+#define FS_FULL_PERCENT 90
+
+struct fs_mount {
+	const char	*path;
+	int		 mounted;
+	long long	 next_check;	/* ms */
+};
+
+/* Mount points to display, if they are mounted */
+static struct fs_mount mounts[FS_MAX] = {
+	{ "/" },
+	{ "/home" },
+	{ "/mnt" }
+};
+
+static int nmounts, mount_count = -1, initialized = 0;
+
+
+int
+fs_init()
+{
+	if (initialized)
+		errx(1, "fs_init called twice");
+
+	initialized = 1;
+
+	for (nmounts = 0; nmounts < FS_MAX && mounts[nmounts].path != NULL;
+	    nmounts++)
+		;
+
+	return nmounts > 0;
+}
+
+/*
+ * The usage of each mounted mount point is cached and only refreshed
+ * with statfs(2) when its interval has expired. The interval is
+ * shortened when a file system is nearly full. A single cheap
+ * getfsstat(2) call counts the mounted file systems; when the number
+ * has changed, every mount point is refreshed at once. The count alone
+ * misses an unmount and a mount in the same check, so every statfs(2)
+ * result is verified to belong to the mount point itself and not to
+ * the file system below it. Mount points which are not mounted are
+ * checked on every call.
+ */
+char *
+fs_info(int *next_update)
+{
+	static char str[FS_BUFLEN];
+	struct statfs sf;
+	long long now, next;
+	int i, n, res, count, changed;
+
+	now = filter_now();
+	next = now + FS_MOUNT_INTERVAL;
+	changed = 0;
+
+	if ((count = getfsstat(NULL, 0, MNT_NOWAIT)) == -1)
+		warn("cannot get number of mounted file systems");
+	else if (count != mount_count) {
+		mount_count = count;
+		changed = 1;
+	}
+
+	for (i = 0; i < nmounts; i++) {
+		if (mounts[i].mounted && !changed &&
+		    now < mounts[i].next_check) {
+			if (mounts[i].next_check < next)
+				next = mounts[i].next_check;
+			continue;
+		}
+		/* not mounted, statfs(2) reports the file system below */
+		if ((res = statfs(mounts[i].path, &sf)) == -1 &&
+		    errno != ENOENT)
+			warn("cannot get usage of %s", mounts[i].path);
+		if (res == -1 || strcmp(sf.f_mntonname, mounts[i].path) != 0) {
+			mounts[i].mounted = 0;
+			status.fs[i].valid = 0;
+			continue;
+		}
+		mounts[i].mounted = 1;
+		status.fs[i].valid = 1;
+		strlcpy(status.fs[i].path, mounts[i].path,
+		    sizeof(status.fs[i].path));
+		status.fs[i].free = (long long)sf.f_bavail * sf.f_bsize;
+		status.fs[i].percent = sf.f_blocks == 0 ? 0 :
+		    (sf.f_blocks - sf.f_bfree) * 100 / sf.f_blocks;
+		mounts[i].next_check = now +
+		    (status.fs[i].percent >= FS_FULL_PERCENT ?
+		    FS_FULL_INTERVAL : FS_INTERVAL);
+		if (mounts[i].next_check < next)
+			next = mounts[i].next_check;
+	}
+
+	if (next_update)
+		*next_update = next > now ? next - now : 1;
+
+	str[0] = '\0';
+	for (i = 0; i < nmounts; i++) {
+		if (!status.fs[i].valid)
+			continue;
+		n = strlen(str);
+		snprintf(str + n, sizeof(str) - n, "%s%s%s %lldG%s",
+		    n > 0 ? " " : "",
+		    status.fs[i].percent >= FS_FULL_PERCENT ?
+		    WARNING_COLOR : "", mounts[i].path,
+		    status.fs[i].free >> 30,
+		    status.fs[i].percent >= FS_FULL_PERCENT ?
+		    NORMAL_COLOR : "");
+	}
+
+	return str[0] != '\0' ? str : NULL;
+}
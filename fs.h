@@ -0,0 +1,4 @@
+#define FS_MAX STATUS_FS_MAX
+
+int     fs_init();
+char   *fs_info(int *);
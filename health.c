@@ -0,0 +1,131 @@
+#include <err.h>
+#include <errno.h>
+#include <stdarg.h>
+
+#include "filter.h"
+#include "health.h"
+
+#define HEALTH_MAX_FAILURES 3
+#define HEALTH_MIN_BACKOFF (5 * 1000)
+#define HEALTH_MAX_BACKOFF (600 * 1000)
+#define HEALTH_WARN_INTERVAL (600 * 1000)
+
+/*
+ * A source is up until it has failed HEALTH_MAX_FAILURES times in a
+ * row. It is then down and only tried again after a backoff, which
+ * doubles with every further failure. One success brings it up again.
+ */
+struct health {
+	int		failures;
+	int		down;
+	int		backoff;	/* ms */
+	long long	retry;
+	long long	last_warn;
+	int		suppressed;
+};
+
+static struct health sources[HEALTH_SOURCES];
+
+static int		health_limit(struct health *);
+
+void
+health_ok(int src)
+{
+	struct health *h = &sources[src];
+
+	h->failures = 0;
+	h->down = 0;
+	h->backoff = 0;
+}
+
+void
+health_fail(int src)
+{
+	struct health *h = &sources[src];
+
+	if (++h->failures < HEALTH_MAX_FAILURES)
+		return;
+
+	h->down = 1;
+	if (h->backoff == 0)
+		h->backoff = HEALTH_MIN_BACKOFF;
+	else if ((h->backoff *= 2) > HEALTH_MAX_BACKOFF)
+		h->backoff = HEALTH_MAX_BACKOFF;
+	h->retry = filter_now() + h->backoff;
+}
+
+/* Should the source be queried now? */
+int
+health_due(int src)
+{
+	struct health *h = &sources[src];
+
+	return !h->down || filter_now() >= h->retry;
+}
+
+/* Returns the ms until the source is due again, 0 if it is due. */
+int
+health_delay(int src)
+{
+	struct health *h = &sources[src];
+	long long delay;
+
+	if (!h->down)
+		return 0;
+
+	delay = h->retry - filter_now();
+	return delay > 0 ? delay : 0;
+}
+
+/*
+ * Like warn(3), but a source warns at most once per
+ * HEALTH_WARN_INTERVAL. The number of suppressed warnings is reported
+ * with the next one.
+ */
+void
+health_warn(int src, const char *fmt, ...)
+{
+	va_list ap;
+	int saved_errno = errno;
+
+	if (!health_limit(&sources[src]))
+		return;
+
+	errno = saved_errno;
+	va_start(ap, fmt);
+	vwarn(fmt, ap);
+	va_end(ap);
+}
+
+void
+health_warnx(int src, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!health_limit(&sources[src]))
+		return;
+
+	va_start(ap, fmt);
+	vwarnx(fmt, ap);
+	va_end(ap);
+}
+
+/* Returns 1 if a warning may be printed. */
+static int
+health_limit(struct health *h)
+{
+	long long now;
+
+	now = filter_now();
+	if (h->last_warn != 0 && now - h->last_warn < HEALTH_WARN_INTERVAL) {
+		h->suppressed++;
+		return 0;
+	}
+
+	if (h->suppressed > 0)
+		warnx("%d similar warnings suppressed", h->suppressed);
+	h->suppressed = 0;
+	h->last_warn = now;
+
+	return 1;
+}
@@ -0,0 +1,13 @@
+#define HEALTH_INTERVAL (5 * 1000)
+
+enum health_sources { HEALTH_MPD, HEALTH_WEATHER, HEALTH_BATTERY,
+    HEALTH_NET, HEALTH_SCRIPTS, HEALTH_SOURCES };
+
+void    health_ok(int);
+void    health_fail(int);
+int     health_due(int);
+int     health_delay(int);
+void    health_warn(int, const char *, ...)
+            __attribute__((__format__ (printf, 2, 3)));
+void    health_warnx(int, const char *, ...)
+            __attribute__((__format__ (printf, 2, 3)));
@@ -0,0 +1,162 @@
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <err.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "history.h"
+#include "status.h"
+
+/* Unchanged values are recorded at least this often (s) */
+#define HISTORY_PERIOD 60
+
+static const int64_t tier_periods[HISTORY_TIERS] = { 0, 60, 3600 };
+
+static struct history *history = NULL;
+static int64_t last_time[HISTORY_METRICS];
+static int last_value[HISTORY_METRICS];
+
+static void	history_add(int, int64_t, int);
+static void	history_store(struct history_ring *, int64_t, int);
+
+int
+history_init()
+{
+	char path[PATH_MAX], *home, *slash;
+	struct stat st;
+	void *p;
+	int fd, i, res = 0;
+
+	if (history != NULL)
+		errx(1, "history_init called twice");
+
+	if ((home = getenv("HOME")) == NULL) {
+		warnx("HOME is not set");
+		goto cleanup_1;
+	}
+	snprintf(path, sizeof(path), "%s" HISTORY_PATH, home);
+
+	slash = strrchr(path, '/');
+	*slash = '\0';
+	mkdir(path, 0755);
+	*slash = '/';
+
+	if ((fd = open(path, O_RDWR | O_CREAT, 0644)) == -1) {
+		warn("cannot open %s", path);
+		goto cleanup_1;
+	}
+
+	if (fstat(fd, &st) == -1) {
+		warn("cannot stat %s", path);
+		goto cleanup_2;
+	}
+
+	if (st.st_size != sizeof(struct history) &&
+	    ftruncate(fd, sizeof(struct history)) == -1) {
+		warn("cannot resize %s", path);
+		goto cleanup_2;
+	}
+
+	p = mmap(NULL, sizeof(struct history), PROT_READ | PROT_WRITE,
+	    MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		warn("cannot map %s", path);
+		goto cleanup_2;
+	}
+	history = p;
+
+	/* start over if the file is new or has an old layout */
+	if (history->magic != HISTORY_MAGIC ||
+	    history->version != HISTORY_VERSION ||
+	    history->metrics != HISTORY_METRICS ||
+	    history->tiers != HISTORY_TIERS) {
+		memset(history, 0, sizeof(struct history));
+		history->version = HISTORY_VERSION;
+		history->metrics = HISTORY_METRICS;
+		history->tiers = HISTORY_TIERS;
+		history->magic = HISTORY_MAGIC;
+	}
+
+	for (i = 0; i < HISTORY_METRICS; i++)
+		last_time[i] = -1;
+
+	res = 1;
+
+cleanup_2:
+	close(fd);
+
+cleanup_1:
+	return res;
+}
+
+/*
+ * Records the numeric values which have changed or have not been
+ * recorded for HISTORY_PERIOD seconds.
+ */
+void
+history_record()
+{
+	int64_t now;
+
+	if (history == NULL)
+		return;
+
+	now = time(NULL);
+
+	if (status.battery.valid)
+		history_add(HISTORY_BATTERY, now, status.battery.percent);
+	if (status.brightness.valid)
+		history_add(HISTORY_BRIGHTNESS, now,
+		    status.brightness.percent);
+	if (status.audio.valid)
+		history_add(HISTORY_VOLUME, now, status.audio.muted ? 0 :
+		    (status.audio.left + status.audio.right) / 2);
+}
+
+static void
+history_add(int metric, int64_t now, int value)
+{
+	struct history_ring *ring;
+	int tier;
+
+	if (last_time[metric] != -1 && value == last_value[metric] &&
+	    now - last_time[metric] < HISTORY_PERIOD)
+		return;
+	last_time[metric] = now;
+	last_value[metric] = value;
+
+	history_store(&history->rings[metric][HISTORY_RAW], now, value);
+
+	/* a finished period is stored as average in the next tier */
+	for (tier = HISTORY_MINUTE; tier < HISTORY_TIERS; tier++) {
+		ring = &history->rings[metric][tier];
+		if (ring->n > 0 &&
+		    now - ring->bucket >= tier_periods[tier]) {
+			history_store(ring, ring->bucket,
+			    ring->sum / ring->n);
+			ring->n = 0;
+		}
+		if (ring->n == 0) {
+			ring->bucket = now - now % tier_periods[tier];
+			ring->sum = 0;
+		}
+		ring->sum += value;
+		ring->n++;
+	}
+}
+
+static void
+history_store(struct history_ring *ring, int64_t time, int value)
+{
+	ring->samples[ring->head].time = time;
+	ring->samples[ring->head].value = value;
+	ring->head = (ring->head + 1) % HISTORY_SAMPLES;
+	if (ring->count < HISTORY_SAMPLES)
+		ring->count++;
+}
@@ -0,0 +1,48 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+
+#define HISTORY_PATH "/.cache/lemonbar-status/history"	/* below $HOME */
+#define HISTORY_MAGIC 0x6c626869	/* "lbhi" */
+#define HISTORY_VERSION 1
+#define HISTORY_SAMPLES 1024
+
+enum history_metric { HISTORY_BATTERY, HISTORY_BRIGHTNESS, HISTORY_VOLUME,
+    HISTORY_METRICS };
+
+/* Raw samples and averages over minutes and hours */
+enum history_tier { HISTORY_RAW, HISTORY_MINUTE, HISTORY_HOUR,
+    HISTORY_TIERS };
+
+struct history_sample {
+	int64_t		time;
+	int32_t		value;
+	int32_t		pad;
+};
+
+struct history_ring {
+	uint32_t	head;		/* next slot */
+	uint32_t	count;
+	int64_t		bucket;		/* start of the accumulated period */
+	int64_t		sum;
+	int64_t		n;
+	struct history_sample samples[HISTORY_SAMPLES];
+};
+
+/*
+ * Layout of the memory mapped history file. It is used in place, so it
+ * survives restarts without being parsed.
+ */
+struct history {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	metrics;
+	uint32_t	tiers;
+	struct history_ring rings[HISTORY_METRICS][HISTORY_TIERS];
+};
+
+int	history_init();
+void	history_record();
+
+#endif /* HISTORY_H */
@@ -0,0 +1,354 @@
+/*
+ * http-test -- runs the HTTP client against a stand-in server
+ *
+ * usage: http-test
+ *
+ * A thread plays a local HTTP server which answers every connection as
+ * the current case demands, and the client code of http.c is driven
+ * like the event loop of lemonbar-status does, with poll(2) in place of
+ * kqueue(2). The cases are:
+ *
+ *	validators	a 200 with an ETag and a Last-Modified date, then a
+ *			request carrying both, which is answered with 304
+ *	status		a 503 is passed on with its status
+ *	timeout		the server never answers; the request stays
+ *			pending until it is abandoned, and the next one
+ *			works
+ *	fallback	the name resolves to a port which refuses the
+ *			connection before the server, so the client has
+ *			to go on to the next address
+ *
+ * getaddrinfo(3) is replaced below, so that the test does not depend
+ * on the resolver configuration.
+ *
+ * Exits with 1 if any case fails.
+ */
+
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <err.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "http.h"
+
+#define TEST_ETAG "\"v1\""
+#define TEST_DATE "Sun, 18 Oct 2026 12:00:00 GMT"
+#define TEST_BODY "{\"weather\":[]}"
+#define TEST_WAIT 2000		/* ms until a request counts as stalled */
+#define TEST_TIMEOUT 300	/* ms the timeout case waits */
+
+enum cases { CASE_VALIDATORS, CASE_STATUS, CASE_TIMEOUT, CASE_FALLBACK };
+
+static atomic_int current;
+static char request[HTTP_BUFLEN];	/* the last one received */
+static int listen_fd, retries;
+static unsigned short port, refusing_port;
+
+static int	test_validators();
+static int	test_status();
+static int	test_timeout();
+static int	test_fallback();
+static int	fetch(const char *, const char *, const char *, int);
+static void    *server(void *);
+static int	server_read(int);
+static void	server_send(int, const char *);
+static struct addrinfo *address(unsigned short, struct addrinfo *);
+
+int
+main(int argc, char *argv[])
+{
+	struct sockaddr_in sin;
+	socklen_t len;
+	pthread_t thread;
+	int failed, fd;
+
+	(void)argv;
+	if (argc != 1) {
+		fprintf(stderr, "usage: http-test\n");
+		return 1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	if ((listen_fd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+		err(1, "socket");
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	len = sizeof(sin);
+	if (bind(listen_fd, (struct sockaddr *)&sin, sizeof(sin)) == -1 ||
+	    listen(listen_fd, 4) == -1 ||
+	    getsockname(listen_fd, (struct sockaddr *)&sin, &len) == -1)
+		err(1, "cannot listen");
+	port = ntohs(sin.sin_port);
+
+	/* bound without listening, so connections are refused */
+	sin.sin_port = 0;
+	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+	    bind(fd, (struct sockaddr *)&sin, sizeof(sin)) == -1 ||
+	    getsockname(fd, (struct sockaddr *)&sin, &len) == -1)
+		err(1, "cannot bind");
+	refusing_port = ntohs(sin.sin_port);
+
+	if (pthread_create(&thread, NULL, server, NULL) != 0)
+		errx(1, "cannot start the server");
+
+	failed = 0;
+	failed |= !test_validators();
+	failed |= !test_status();
+	failed |= !test_timeout();
+	failed |= !test_fallback();
+
+	return failed;
+}
+
+static int
+test_validators()
+{
+	const struct http_response *r;
+	char url[64];
+	int ok;
+
+	atomic_store(&current, CASE_VALIDATORS);
+	snprintf(url, sizeof(url), "http://127.0.0.1:%u/current", port);
+
+	ok = fetch(url, "", "", TEST_WAIT) == HTTP_DONE;
+	r = http_response();
+	ok = ok && r->status == 200 && strcmp(r->etag, TEST_ETAG) == 0 &&
+	    strcmp(r->last_modified, TEST_DATE) == 0 &&
+	    r->len == sizeof(TEST_BODY) - 1 &&
+	    memcmp(r->body, TEST_BODY, r->len) == 0;
+
+	ok = ok && fetch(url, TEST_ETAG, TEST_DATE, TEST_WAIT) == HTTP_DONE;
+	r = http_response();
+	ok = ok && r->status == 304 && r->len == 0 &&
+	    strstr(request, "If-None-Match: " TEST_ETAG "\r\n") != NULL &&
+	    strstr(request, "If-Modified-Since: " TEST_DATE "\r\n") != NULL;
+
+	printf("%-12s %s\n", "validators", ok ? "ok" : "FAILED");
+	return ok;
+}
+
+static int
+test_status()
+{
+	char url[64];
+	int ok;
+
+	atomic_store(&current, CASE_STATUS);
+	snprintf(url, sizeof(url), "http://127.0.0.1:%u/current", port);
+
+	ok = fetch(url, "", "", TEST_WAIT) == HTTP_DONE &&
+	    http_response()->status == 503;
+
+	printf("%-12s %s\n", "status", ok ? "ok" : "FAILED");
+	return ok;
+}
+
+static int
+test_timeout()
+{
+	char url[64];
+	int ok;
+
+	atomic_store(&current, CASE_TIMEOUT);
+	snprintf(url, sizeof(url), "http://127.0.0.1:%u/current", port);
+
+	ok = fetch(url, "", "", TEST_TIMEOUT) == HTTP_PENDING;
+
+	/* the abandoned request must not leak into the next one */
+	atomic_store(&current, CASE_VALIDATORS);
+	ok = ok && fetch(url, "", "", TEST_WAIT) == HTTP_DONE &&
+	    http_response()->status == 200;
+
+	printf("%-12s %s\n", "timeout", ok ? "ok" : "FAILED");
+	return ok;
+}
+
+static int
+test_fallback()
+{
+	char url[64];
+	int ok;
+
+	atomic_store(&current, CASE_FALLBACK);
+	snprintf(url, sizeof(url), "http://fallback.test:%u/current", port);
+
+	retries = 0;
+	ok = fetch(url, "", "", TEST_WAIT) == HTTP_DONE &&
+	    http_response()->status == 200 && retries == 1;
+
+	printf("%-12s %s\n", "fallback", ok ? "ok" : "FAILED");
+	return ok;
+}
+
+/*
+ * Runs one request for at most wait ms. Returns HTTP_DONE, HTTP_FAILED
+ * or HTTP_PENDING if it was abandoned. The descriptor is always closed.
+ */
+static int
+fetch(const char *url, const char *etag, const char *last_modified,
+    int wait)
+{
+	struct pollfd pfd;
+	int fd, res, sent;
+
+	if ((fd = http_get(url, etag, last_modified)) == -1)
+		return HTTP_FAILED;
+
+	/* like the one-shot EVFILT_WRITE of the event loop */
+	sent = 0;
+	for (;;) {
+		pfd.fd = fd;
+		pfd.events = sent ? POLLIN : POLLOUT;
+		if (poll(&pfd, 1, wait) <= 0) {
+			res = HTTP_PENDING;
+			break;
+		}
+		res = http_event(&fd, sent ? EVFILT_READ : EVFILT_WRITE);
+		if (res == HTTP_RETRY) {
+			retries++;
+			sent = 0;
+			continue;
+		}
+		if (res != HTTP_PENDING)
+			break;
+		sent = 1;
+	}
+
+	http_close(fd);
+	return res;
+}
+
+/* Answers the connections as the current case demands. */
+static void *
+server(void *arg)
+{
+	int fd;
+
+	(void)arg;
+
+	for (;;) {
+		if ((fd = accept(listen_fd, NULL, NULL)) == -1)
+			err(1, "accept");
+		if (!server_read(fd)) {
+			close(fd);
+			continue;
+		}
+
+		switch (atomic_load(&current)) {
+		case CASE_VALIDATORS:
+		case CASE_FALLBACK:
+			if (strstr(request, "If-None-Match: " TEST_ETAG) !=
+			    NULL)
+				server_send(fd, "HTTP/1.0 304 Not Modified\r\n"
+				    "ETag: " TEST_ETAG "\r\n\r\n");
+			else
+				server_send(fd, "HTTP/1.0 200 OK\r\n"
+				    "Content-Type: application/json\r\n"
+				    "ETag: " TEST_ETAG "\r\n"
+				    "Last-Modified: " TEST_DATE "\r\n\r\n"
+				    TEST_BODY);
+			break;
+		case CASE_STATUS:
+			server_send(fd, "HTTP/1.0 503 Service Unavailable\r\n"
+			    "\r\nbusy");
+			break;
+		case CASE_TIMEOUT:
+			/* wait for the client to give up */
+			while (recv(fd, request, sizeof(request), 0) > 0)
+				;
+			break;
+		}
+		close(fd);
+	}
+
+	return NULL;
+}
+
+/* Reads a request up to the empty line. Returns 0 if it is cut off. */
+static int
+server_read(int fd)
+{
+	size_t len;
+	ssize_t n;
+
+	for (len = 0; len < sizeof(request) - 1; len += n) {
+		if ((n = recv(fd, request + len, sizeof(request) - 1 - len,
+		    0)) <= 0)
+			return 0;
+		request[len + n] = '\0';
+		if (strstr(request, "\r\n\r\n") != NULL)
+			return 1;
+	}
+
+	return 0;
+}
+
+static void
+server_send(int fd, const char *str)
+{
+	send(fd, str, strlen(str), 0);
+}
+
+/*
+ * Resolves every name to the loopback address with the given port,
+ * "fallback.test" to the refusing port first.
+ */
+int
+getaddrinfo(const char *host, const char *serv, const struct addrinfo *hints,
+    struct addrinfo **res)
+{
+	(void)hints;
+
+	*res = address(atoi(serv), NULL);
+	if (strcmp(host, "fallback.test") == 0)
+		*res = address(refusing_port, *res);
+
+	return 0;
+}
+
+void
+freeaddrinfo(struct addrinfo *ai)
+{
+	struct addrinfo *next;
+
+	for (; ai != NULL; ai = next) {
+		next = ai->ai_next;
+		free(ai->ai_addr);
+		free(ai);
+	}
+}
+
+static struct addrinfo *
+address(unsigned short p, struct addrinfo *next)
+{
+	struct addrinfo *ai;
+	struct sockaddr_in *sin;
+
+	if ((ai = calloc(1, sizeof(*ai))) == NULL ||
+	    (sin = calloc(1, sizeof(*sin))) == NULL)
+		err(1, NULL);
+	sin->sin_family = AF_INET;
+	sin->sin_port = htons(p);
+	sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	ai->ai_family = AF_INET;
+	ai->ai_socktype = SOCK_STREAM;
+	ai->ai_addr = (struct sockaddr *)sin;
+	ai->ai_addrlen = sizeof(*sin);
+	ai->ai_next = next;
+
+	return ai;
+}
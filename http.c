@@ -0,0 +1,279 @@
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/socket.h>
+#include <err.h>
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "http.h"
+
+#define HTTP_HOSTLEN 256
+#define HTTP_REQUESTLEN 1024
+
+/*
+ * The single request in progress. The descriptor is watched for
+ * writing until the connection is established and the request sent,
+ * then for reading until the server closes the connection. The
+ * addresses not tried yet are kept in case the connection fails.
+ */
+static struct {
+	char		 request[HTTP_REQUESTLEN];
+	int		 sent;
+	char		 buf[HTTP_BUFLEN];
+	size_t		 len;
+	struct addrinfo	*addrs;
+	struct addrinfo	*next;
+	struct http_response response;
+} http;
+
+static int	http_connect();
+static int	http_url(const char *, char *, char *, const char **);
+static int	http_parse();
+static void	http_header(const char *, const char *, char *, size_t);
+
+/*
+ * Starts a GET request for an http:// URL. The validators of a cached
+ * response are sent along, so the server may answer 304 instead. The
+ * name is resolved synchronously, the rest does not block. Returns the
+ * descriptor to be passed to http_event() or -1.
+ */
+int
+http_get(const char *url, const char *etag, const char *last_modified)
+{
+	struct addrinfo hints;
+	char host[HTTP_HOSTLEN], port[8];
+	const char *path;
+	int fd, n, error;
+
+	if (!http_url(url, host, port, &path)) {
+		warnx("unsupported URL %s", url);
+		return -1;
+	}
+
+	/* HTTP/1.0, so the body is neither chunked nor kept alive */
+	n = snprintf(http.request, sizeof(http.request),
+	    "GET %s HTTP/1.0\r\nHost: %.*s\r\nAccept: application/json\r\n"
+	    "%s%s%s%s%s%s\r\n", path, (int)strcspn(url + 7, "/"), url + 7,
+	    etag[0] ? "If-None-Match: " : "", etag, etag[0] ? "\r\n" : "",
+	    last_modified[0] ? "If-Modified-Since: " : "", last_modified,
+	    last_modified[0] ? "\r\n" : "");
+	if (n < 0 || (size_t)n >= sizeof(http.request)) {
+		warnx("request for %s too long", url);
+		return -1;
+	}
+	http.sent = 0;
+	http.len = 0;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if ((error = getaddrinfo(host, port, &hints, &http.addrs)) != 0) {
+		warnx("cannot resolve %s: %s", host, gai_strerror(error));
+		http.addrs = NULL;
+		return -1;
+	}
+	http.next = http.addrs;
+
+	if ((fd = http_connect()) == -1) {
+		warn("cannot connect to %s", host);
+		freeaddrinfo(http.addrs);
+		http.addrs = NULL;
+	}
+
+	return fd;
+}
+
+/*
+ * Starts a non-blocking connection to the next address which accepts
+ * one. Returns the descriptor or -1 if no address is left.
+ */
+static int
+http_connect()
+{
+	struct addrinfo *ai;
+	int fd;
+
+	while ((ai = http.next) != NULL) {
+		http.next = ai->ai_next;
+		if ((fd = socket(ai->ai_family, ai->ai_socktype |
+		    SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol)) == -1)
+			continue;
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0 ||
+		    errno == EINPROGRESS)
+			return fd;
+		close(fd);
+	}
+
+	return -1;
+}
+
+/*
+ * Continues the request after an event of filter on *fd. If the
+ * connection has failed, the next address is tried: *fd is then
+ * replaced and HTTP_RETRY returned, the new descriptor has to be
+ * watched like the first one. Returns HTTP_DONE once the whole response
+ * has been received and parsed; the caller closes *fd in that case and
+ * after HTTP_FAILED.
+ */
+int
+http_event(int *fd, int filter)
+{
+	size_t len;
+	ssize_t n;
+	int error, next;
+	socklen_t size;
+
+	/* either event may report a failed connection */
+	if (!http.sent) {
+		size = sizeof(error);
+		if (getsockopt(*fd, SOL_SOCKET, SO_ERROR, &error, &size)
+		    == -1 || error != 0) {
+			errno = error;
+			warn("cannot connect");
+			/* opened first, so the number differs from *fd */
+			if ((next = http_connect()) == -1)
+				return HTTP_FAILED;
+			close(*fd);
+			*fd = next;
+			return HTTP_RETRY;
+		}
+		if (filter != EVFILT_WRITE)
+			return HTTP_PENDING;
+	}
+
+	if (filter == EVFILT_WRITE) {
+		if (http.sent)
+			return HTTP_PENDING;
+		/* the request fits into an empty socket buffer */
+		len = strlen(http.request);
+		if (send(*fd, http.request, len, 0) != (ssize_t)len) {
+			warn("cannot send request");
+			return HTTP_FAILED;
+		}
+		http.sent = 1;
+		return HTTP_PENDING;
+	}
+
+	n = recv(*fd, http.buf + http.len, sizeof(http.buf) - http.len - 1, 0);
+	if (n == -1)
+		return errno == EAGAIN ? HTTP_PENDING : HTTP_FAILED;
+	if (n > 0) {
+		http.len += n;
+		if (http.len < sizeof(http.buf) - 1)
+			return HTTP_PENDING;
+		warnx("response too long");
+		return HTTP_FAILED;
+	}
+
+	http.buf[http.len] = '\0';
+	return http_parse() ? HTTP_DONE : HTTP_FAILED;
+}
+
+/* The last response, valid after HTTP_DONE */
+const struct http_response *
+http_response()
+{
+	return &http.response;
+}
+
+void
+http_close(int fd)
+{
+	close(fd);
+	http.sent = 0;
+	http.len = 0;
+	if (http.addrs != NULL)
+		freeaddrinfo(http.addrs);
+	http.addrs = http.next = NULL;
+}
+
+/* Splits an http:// URL. Returns 0 for anything else. */
+static int
+http_url(const char *url, char *host, char *port, const char **path)
+{
+	const char *p, *end, *colon;
+	size_t len;
+
+	if (strncmp(url, "http://", 7) != 0)
+		return 0;
+	p = url + 7;
+
+	if ((end = strchr(p, '/')) == NULL)
+		end = p + strlen(p);
+	*path = *end != '\0' ? end : "/";
+
+	if ((colon = memchr(p, ':', end - p)) != NULL) {
+		len = end - colon - 1;
+		if (len == 0 || len >= 8)
+			return 0;
+		memcpy(port, colon + 1, len);
+		port[len] = '\0';
+		end = colon;
+	} else
+		strlcpy(port, "80", 8);
+
+	len = end - p;
+	if (len == 0 || len >= HTTP_HOSTLEN)
+		return 0;
+	memcpy(host, p, len);
+	host[len] = '\0';
+
+	return 1;
+}
+
+/* Splits the received data into status, validators and body. */
+static int
+http_parse()
+{
+	struct http_response *r = &http.response;
+	char *body;
+
+	memset(r, 0, sizeof(*r));
+
+	if (sscanf(http.buf, "HTTP/%*d.%*d %d", &r->status) != 1) {
+		warnx("invalid HTTP response");
+		return 0;
+	}
+	if ((body = strstr(http.buf, "\r\n\r\n")) == NULL) {
+		warnx("incomplete HTTP response");
+		return 0;
+	}
+	*body = '\0';
+	r->body = body + 4;
+	r->len = http.len - (r->body - http.buf);
+
+	http_header(http.buf, "ETag", r->etag, sizeof(r->etag));
+	http_header(http.buf, "Last-Modified", r->last_modified,
+	    sizeof(r->last_modified));
+
+	return 1;
+}
+
+/* Copies the value of the header name, or an empty string. */
+static void
+http_header(const char *headers, const char *name, char *dst, size_t size)
+{
+	const char *p, *end;
+	size_t len = strlen(name);
+
+	dst[0] = '\0';
+	for (p = strstr(headers, "\r\n"); p != NULL;
+	    p = strstr(p, "\r\n")) {
+		p += 2;
+		if (strncasecmp(p, name, len) != 0 || p[len] != ':')
+			continue;
+		p += len + 1;
+		p += strspn(p, " \t");
+		if ((end = strstr(p, "\r\n")) == NULL)
+			end = p + strlen(p);
+		if ((size_t)(end - p) < size) {
+			memcpy(dst, p, end - p);
+			dst[end - p] = '\0';
+		}
+		return;
+	}
+}
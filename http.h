@@ -0,0 +1,20 @@
+#define HTTP_TIMEOUT (15 * 1000)
+#define HTTP_BUFLEN 16384
+#define HTTP_ETAGLEN 128
+#define HTTP_DATELEN 64
+
+/* Result of http_event() */
+enum http_states { HTTP_FAILED = -1, HTTP_PENDING, HTTP_DONE, HTTP_RETRY };
+
+struct http_response {
+	int		 status;
+	char		 etag[HTTP_ETAGLEN];
+	char		 last_modified[HTTP_DATELEN];
+	const char	*body;
+	size_t		 len;
+};
+
+int     http_get(const char *, const char *, const char *);
+int     http_event(int *, int);
+const struct http_response *http_response();
+void    http_close(int);
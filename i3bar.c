@@ -0,0 +1,143 @@
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+#include <json-c/json.h>
+
+#include "config.h"
+#include "i3bar.h"
+#include "marquee.h"
+#include "status.h"
+
+#define I3BAR_TEXTLEN 512
+#define I3BAR_BLOCKLEN 768
+#define I3BAR_FRAMELEN (INFO_ARRAY_SIZE * I3BAR_BLOCKLEN)
+
+/*
+ * The last text of every element and its encoding as a block. A block
+ * is only encoded again if the text has changed.
+ */
+static struct {
+	char	text[I3BAR_TEXTLEN];
+	char	json[I3BAR_BLOCKLEN];
+	int	shown;
+} blocks[INFO_ARRAY_SIZE];
+static int first = 1;
+
+static int	i3bar_encode(int, const char *);
+
+/*
+ * Starts the infinite array of the i3bar protocol. After a re-exec the
+ * array has already been started by the previous image.
+ */
+void
+i3bar_init(int resumed)
+{
+	if (resumed) {
+		first = 0;
+		return;
+	}
+
+	fputs("{\"version\":1,\"click_events\":true}\n[\n", stdout);
+	fflush(stdout);
+}
+
+/*
+ * Writes the array of blocks in the configured order, which is spliced
+ * from the cached encodings, unless no block has changed and the
+ * configuration was not reloaded.
+ */
+void
+i3bar_output(char *infos[])
+{
+	static char frame[I3BAR_FRAMELEN];
+	static const struct config *layout = NULL;
+	char *str;
+	size_t n;
+	int i, j, changed;
+
+	changed = layout != config;
+	layout = config;
+	for (j = 0; j < config->norder; j++) {
+		i = config->order[j];
+		if ((str = marquee_apply(i, infos[i])) == NULL) {
+			changed |= blocks[i].shown;
+			blocks[i].shown = 0;
+			continue;
+		}
+		if (!blocks[i].shown || strcmp(str, blocks[i].text) != 0) {
+			changed = 1;
+			blocks[i].shown = i3bar_encode(i, str);
+		}
+	}
+
+	if (!changed)
+		return;
+
+	n = strlcpy(frame, first ? "[" : ",[", sizeof(frame));
+	for (j = 0; j < config->norder; j++) {
+		i = config->order[j];
+		if (!blocks[i].shown)
+			continue;
+		if (frame[n - 1] != '[')
+			n += strlcpy(frame + n, ",", sizeof(frame) - n);
+		n += strlcpy(frame + n, blocks[i].json, sizeof(frame) - n);
+		if (n >= sizeof(frame)) {
+			warnx("i3bar frame too long");
+			return;
+		}
+	}
+	strlcat(frame, "]\n", sizeof(frame));
+	first = 0;
+
+	fputs(frame, stdout);
+	fflush(stdout);
+}
+
+/*
+ * Encodes an element as a block. Formatting tags are removed; a color
+ * tag at the start of the text becomes the color of the block. Returns
+ * 1 on success.
+ */
+static int
+i3bar_encode(int i, const char *str)
+{
+	struct json_object *obj;
+	char text[I3BAR_TEXTLEN], color[8];
+	const char *p, *end;
+	size_t n;
+
+	strlcpy(blocks[i].text, str, sizeof(blocks[i].text));
+
+	color[0] = '\0';
+	if (strncmp(str, "%{F#", 4) == 0 && strlen(str) > 10 &&
+	    str[10] == '}')
+		snprintf(color, sizeof(color), "#%.6s", str + 4);
+
+	for (p = str, n = 0; *p != '\0' && n < sizeof(text) - 1; p++) {
+		if (p[0] == '%' && p[1] == '{' &&
+		    (end = strchr(p, '}')) != NULL) {
+			p = end;
+			continue;
+		}
+		if (p[0] == '%' && p[1] == '%')
+			p++;
+		text[n++] = *p;
+	}
+	text[n] = '\0';
+
+	if ((obj = json_object_new_string(text)) == NULL) {
+		warnx("cannot create JSON string");
+		return 0;
+	}
+	n = snprintf(blocks[i].json, sizeof(blocks[i].json),
+	    "{\"name\":\"%s\",\"full_text\":%s%s%s%s}", status_names[i],
+	    json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PLAIN),
+	    color[0] ? ",\"color\":\"" : "", color, color[0] ? "\"" : "");
+	json_object_put(obj);
+	if (n >= sizeof(blocks[i].json)) {
+		warnx("i3bar block too long");
+		return 0;
+	}
+
+	return 1;
+}
@@ -0,0 +1,2 @@
+void    i3bar_init(int);
+void    i3bar_output(char **);
@@ -0,0 +1,127 @@
+/*
+ * lemonbar-history -- dumps the value history of lemonbar-status
+ *
+ * usage: lemonbar-history [-t raw | minute | hour] [metric ...]
+ *
+ * Prints one line per sample with the metric name, the time and the
+ * value, oldest first.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <err.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "history.h"
+
+static const char *history_metric_names[HISTORY_METRICS] = { "battery",
+    "brightness", "volume" };
+static const char *history_tier_names[HISTORY_TIERS] = { "raw", "minute",
+    "hour" };
+
+static void	dump(const struct history_ring *, const char *);
+static void	usage();
+
+int
+main(int argc, char *argv[])
+{
+	const struct history *history;
+	struct history header;
+	struct stat st;
+	size_t len;
+	char path[PATH_MAX], *home;
+	int ch, fd, i, metric, tier;
+
+	tier = HISTORY_RAW;
+
+	while ((ch = getopt(argc, argv, "t:")) != -1) {
+		switch (ch) {
+		case 't':
+			for (tier = 0; tier < HISTORY_TIERS; tier++)
+				if (strcmp(optarg,
+				    history_tier_names[tier]) == 0)
+					break;
+			if (tier == HISTORY_TIERS)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if ((home = getenv("HOME")) == NULL)
+		errx(1, "HOME is not set");
+	snprintf(path, sizeof(path), "%s" HISTORY_PATH, home);
+
+	if ((fd = open(path, O_RDONLY)) == -1)
+		err(1, "cannot open %s", path);
+
+	/* a short file would fault on access, so check before mapping */
+	if (fstat(fd, &st) == -1)
+		err(1, "cannot stat %s", path);
+	len = offsetof(struct history, rings);
+	if (st.st_size != (off_t)sizeof(struct history) ||
+	    pread(fd, &header, len, 0) != (ssize_t)len ||
+	    header.magic != HISTORY_MAGIC ||
+	    header.version != HISTORY_VERSION ||
+	    header.metrics != HISTORY_METRICS || header.tiers != HISTORY_TIERS)
+		errx(1, "%s has an unknown format", path);
+
+	history = mmap(NULL, sizeof(struct history), PROT_READ, MAP_SHARED,
+	    fd, 0);
+	if (history == MAP_FAILED)
+		err(1, "cannot map %s", path);
+	close(fd);
+
+	if (argc == 0) {
+		for (metric = 0; metric < HISTORY_METRICS; metric++)
+			dump(&history->rings[metric][tier],
+			    history_metric_names[metric]);
+		return 0;
+	}
+
+	for (i = 0; i < argc; i++) {
+		for (metric = 0; metric < HISTORY_METRICS; metric++)
+			if (strcmp(argv[i], history_metric_names[metric]) == 0)
+				break;
+		if (metric == HISTORY_METRICS)
+			errx(1, "unknown metric %s", argv[i]);
+		dump(&history->rings[metric][tier], argv[i]);
+	}
+
+	return 0;
+}
+
+static void
+dump(const struct history_ring *ring, const char *name)
+{
+	char buf[32];
+	time_t t;
+	uint32_t i, idx;
+
+	for (i = 0; i < ring->count; i++) {
+		idx = (ring->head + HISTORY_SAMPLES - ring->count + i) %
+		    HISTORY_SAMPLES;
+		t = ring->samples[idx].time;
+		strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&t));
+		printf("%s\t%s\t%d\n", name, buf, ring->samples[idx].value);
+	}
+}
+
+static void
+usage()
+{
+	fprintf(stderr,
+	    "usage: lemonbar-history [-t raw | minute | hour] [metric ...]\n");
+	exit(1);
+}
@@ -7,6 +7,7 @@
 #include <fcntl.h>
 
 #include "colors.h"
+#include "status.h"
 
 #define MAIL_TEXT "MAIL"
 #define MAILPATH_BUFLEN 256
@@ -40,6 +41,8 @@ mail_info(int fd)
 {
     	struct stat st;
 
+	status.mail.valid = 0;
+
 	if (fd < 0) {
 	    	warn("invalid mail file descriptor");
 		return NULL;
@@ -50,7 +53,10 @@ mail_info(int fd)
 		return NULL;
 	}
 
-	if (timespec_later(&st.st_mtim, &st.st_atim))
+	status.mail.valid = 1;
+	status.mail.unread = timespec_later(&st.st_mtim, &st.st_atim);
+
+	if (status.mail.unread)
 		return MAIL_COLOR MAIL_TEXT NORMAL_COLOR;
 	else
 		return NULL;
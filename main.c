@@ -21,8 +21,19 @@
  * the weather, and the date and outputs a line on standard ouput
  * which can be processes by lemonbar.
  *
- * The program does not take any commandline arguments and is not
- * configurable.
+ * The order of the elements, the interface, the RandR output, the
+ * audio keys, the weather directory, MPD and the intervals are read
+ * from ~/.config/lemonbar-status/config, which is applied again when
+ * it changes. The only commandline arguments select the i3bar protocol
+ * instead of lemonbar markup and the recording or the replay of an
+ * event trace:
+ *
+ *	lemonbar-status [-j] [-r trace]
+ *	lemonbar-status [-j] -p trace [-s speed]
+ *
+ * On SIGHUP the program executes itself again without interrupting the
+ * bar. The new image is started with the hidden option -R, which names
+ * the handed over MPD connection or is -1.
  *
  * If it is appropriate, the program waits for events from the information
  * sources. Otherwise the information is polled at regular intervals.
@@ -32,6 +43,9 @@
 #include <sys/event.h>
 
 #include <err.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -39,90 +53,455 @@
 #include <unistd.h>
 
 #include "audio.h"
+#include "backlight.h"
 #include "battery.h"
 #include "clock.h"
 #include "colors.h"
+#include "command.h"
+#include "config.h"
+#include "fs.h"
+#include "health.h"
+#include "history.h"
+#include "http.h"
+#include "i3bar.h"
 #include "mail.h"
+#include "marquee.h"
 #include "mpd.h"
 #include "net.h"
+#include "netrate.h"
+#include "query.h"
+#include "script.h"
+#include "snapshot.h"
+#include "status.h"
+#include "system.h"
+#include "thermal.h"
+#include "trace.h"
 #include "weather.h"
+#include "worker.h"
 #include "x.h"
 
-#define EVENTS 10
+#define EVENTS 32
+#define CHANGES (4 * EVENTS)
+#define FRAME_BUFLEN 2048
 
-enum infos { INFO_MPD, INFO_MAIL, INFO_NETWORK, INFO_BATTERY,
-    INFO_BRIGHTNESS, INFO_AUDIO, INFO_WEATHER, INFO_CLOCK,
-    INFO_ARRAY_SIZE };
+enum timer_ids { CLOCK_TIMER, BATTERY_TIMER, NET_TIMER,
+    BRIGHTNESS_TIMER, AUDIO_TIMER, SCRIPT_TIMER, SYSTEM_TIMER,
+    NETRATE_TIMER, THERMAL_TIMER, FS_TIMER, MARQUEE_TIMER, WINDOW_TIMER,
+    HEALTH_TIMER, WEATHER_TIMER };
 
-#define LEFT_ALIGNED INFO_MPD
+/* Click actions, only emitted if commands are read from standard input */
+static const char *actions[INFO_ARRAY_SIZE][2] = {
+	[INFO_MPD] = { "%{A:mpd toggle:}%{A3:mpd next:}", "%{A}%{A}" },
+	[INFO_AUDIO] = {
+	    "%{A:volume mute:}%{A4:volume up:}%{A5:volume down:}",
+	    "%{A}%{A}%{A}" }
+};
+static int clickable = 0, i3bar = 0;
 
-enum timer_ids { CLOCK_TIMER, BATTERY_TIMER, NET_TIMER,
-    BRIGHTNESS_TIMER, AUDIO_TIMER };
+static char frame[FRAME_BUFLEN];
 
+/* Where the scrolling segments lie in the frame */
+static struct span {
+	int	info;
+	size_t	start;
+	size_t	len;
+} spans[INFO_ARRAY_SIZE];
+static int nspans;
+
+static void	output_append(const char *);
+static void	output_segment(char **, int);
+static void	output_element(char **, int);
 static void	output_elements(char **, int, int);
+static void	output_write();
 static void	output_status(char **);
+static void	output_scroll(char **);
+static int	mpd_connect(char **);
+static int	resume(char **, int);
+static void	reexec(int, char **, int);
+static void	usage();
+
+static void
+output_append(const char *str)
+{
+	strlcat(frame, str, sizeof(frame));
+}
+
+/* Long elements are cut off or scrolled to their width budget. */
+static void
+output_segment(char *infos[], int i)
+{
+	char *str;
+	size_t start, len;
+
+	str = marquee_apply(i, infos[i]);
+	start = strlen(frame);
+	len = strlen(str);
+	output_append(str);
+	if (!marquee_scrolling(i))
+		return;
+
+	/* a cut off frame is always formatted in full */
+	if (start + len >= sizeof(frame) || nspans == INFO_ARRAY_SIZE) {
+		nspans = 0;
+		return;
+	}
+	spans[nspans].info = i;
+	spans[nspans].start = start;
+	spans[nspans++].len = len;
+}
 
+static void
+output_element(char *infos[], int i)
+{
+	if (clickable && actions[i][0] != NULL) {
+		output_append(actions[i][0]);
+		output_segment(infos, i);
+		output_append(actions[i][1]);
+	} else
+		output_segment(infos, i);
+}
+
+/* Appends the elements from start to end of the configured order. */
 static void
 output_elements(char *infos[], int start, int end)
 {
         int i;
 
 	for (i = start; i < end; i++) {
-		if (infos[i] == NULL)
+		if (infos[config->order[i]] == NULL)
 			continue;
-		fputs(infos[i], stdout);
+		output_element(infos, config->order[i]);
 		i++;
 		break;
 	}
 
 	for (; i < end; i++) {
-		if (infos[i] == NULL)
+		if (infos[config->order[i]] == NULL)
 			continue;
-		fputs(" " SEPARATOR_COLOR "|" NORMAL_COLOR " ", stdout);
-		fputs(infos[i], stdout);
+		output_append(" " SEPARATOR_COLOR "|" NORMAL_COLOR " ");
+		output_element(infos, config->order[i]);
 	}
 }
 
+/* Writes the frame unless it is equal to the previous one. */
+static void
+output_write()
+{
+	static char last_frame[FRAME_BUFLEN];
+
+	if (strcmp(frame, last_frame) == 0)
+		return;
+	strlcpy(last_frame, frame, sizeof(last_frame));
+
+	fputs(frame, stdout);
+	putc('\n', stdout);
+	fflush(stdout);
+}
+
 static void
 output_status(char *infos[])
 {
 	int i;
 
+	if (i3bar) {
+		i3bar_output(infos);
+		return;
+	}
+
+	frame[0] = '\0';
+	nspans = 0;
+
         /* search first left aligned element */
-        for (i = 0; i < INFO_ARRAY_SIZE && infos[i] == NULL; i++)
+        for (i = 0; i < config->nleft && infos[config->order[i]] == NULL;
+            i++)
                 ;
 
-        if (i <= LEFT_ALIGNED) {
-                fputs(NORMAL_COLOR "%{l}", stdout);
-                output_elements(infos, i, LEFT_ALIGNED + 1);
-                i++;
+        if (i < config->nleft) {
+                output_append(NORMAL_COLOR "%{l}");
+                output_elements(infos, i, config->nleft);
         }
 
         /* search first right aligned element */
-        for (; i < INFO_ARRAY_SIZE && infos[i] == NULL; i++)
+        for (i = config->nleft; i < config->norder &&
+            infos[config->order[i]] == NULL; i++)
                 ;
 
         /* if first right aligned element found */
-        if (i < INFO_ARRAY_SIZE) {
-                fputs(NORMAL_COLOR "%{r}", stdout);
-                output_elements(infos, i, INFO_ARRAY_SIZE);
+        if (i < config->norder) {
+                output_append(NORMAL_COLOR "%{r}");
+                output_elements(infos, i, config->norder);
         }
 
-	putc('\n', stdout);
+	output_write();
+}
+
+/*
+ * Replaces only the scrolling segments of the previous frame by their
+ * next window; all other elements are neither formatted nor copied
+ * one by one. Falls back to a full frame if the line would not fit.
+ */
+static void
+output_scroll(char *infos[])
+{
+	char line[FRAME_BUFLEN];
+	const char *str;
+	size_t pos, len, n, linelen;
+	int k;
+
+	if (i3bar || nspans == 0) {
+		output_status(infos);
+		return;
+	}
+
+	linelen = strlcpy(line, frame, sizeof(line));
+	pos = n = 0;
+	for (k = 0; k < nspans; k++) {
+		str = marquee_apply(spans[k].info, infos[spans[k].info]);
+		len = strlen(str);
+		if (spans[k].start < pos ||
+		    spans[k].start + spans[k].len > linelen ||
+		    n + spans[k].start - pos + len >= sizeof(frame)) {
+			output_status(infos);
+			return;
+		}
+		memcpy(frame + n, line + pos, spans[k].start - pos);
+		n += spans[k].start - pos;
+		pos = spans[k].start + spans[k].len;
+
+		spans[k].start = n;
+		spans[k].len = len;
+		memcpy(frame + n, str, len);
+		n += len;
+	}
+	if (strlcpy(frame + n, line + pos, sizeof(frame) - n) >=
+	    sizeof(frame) - n) {
+		output_status(infos);
+		return;
+	}
+
+	output_write();
+}
+
+/*
+ * Connects to MPD and enters idle mode. Returns the descriptor or -1;
+ * failed attempts are retried with a growing backoff.
+ */
+static int
+mpd_connect(char *infos[])
+{
+	int fd;
+
+	if ((fd = mpd_init()) < 0) {
+		health_fail(HEALTH_MPD);
+		return -1;
+	}
+
+	if ((infos[INFO_MPD] = mpd_info(fd)) == NULL) {
+		mpd_close(fd);
+		health_fail(HEALTH_MPD);
+		return -1;
+	}
+
+	health_ok(HEALTH_MPD);
+	mpd_idle_start(fd);
+	return fd;
+}
+
+/*
+ * Writes the first frame from the values which the previous image has
+ * left in the snapshot, before any source is queried. Afterwards only
+ * MPD is kept, if its connection was handed over; it is still idle and
+ * fetched again at the next change. All other sources are initialized
+ * as usual and the unchanged frame is not written again. Returns 0 if
+ * there was nothing to restore.
+ */
+static int
+resume(char *infos[], int mpd_fd)
+{
+	static char segments[INFO_ARRAY_SIZE][SNAPSHOT_SEGLEN];
+	char path[PATH_MAX];
+	struct status_mpd mpd;
+	int i;
+
+	if (!snapshot_path(path, sizeof(path)) ||
+	    !snapshot_restore(path, segments))
+		return 0;
+
+	for (i = 0; i < INFO_ARRAY_SIZE; i++)
+		infos[i] = segments[i][0] != '\0' ? segments[i] : NULL;
+	output_status(infos);
+
+	mpd = status.mpd;
+	bzero(&status, sizeof(status));
+	bzero(infos, INFO_ARRAY_SIZE * sizeof(char *));
+
+	if (mpd_fd >= 0) {
+		status.mpd = mpd;
+		infos[INFO_MPD] = segments[INFO_MPD][0] != '\0' ?
+		    segments[INFO_MPD] : NULL;
+		mpd_resume();
+	}
+
+	return 1;
+}
+
+/*
+ * Executes the program again with the same arguments. Standard input
+ * and output, the pipes to the bar, stay open and the MPD connection
+ * is handed over; every other descriptor is closed by the execution.
+ * Only returns if it has failed, the program then simply continues.
+ */
+static void
+reexec(int argc, char *argv[], int mpd_fd)
+{
+	char **args, fd_arg[16];
+	int i, n, fd, nfds;
+
+	if ((args = calloc(argc + 3, sizeof(char *))) == NULL) {
+		warn("cannot re-execute");
+		return;
+	}
+
+	/* drop the option of an earlier re-exec */
+	for (i = n = 0; i < argc; i++) {
+		if (strcmp(argv[i], "-R") == 0 && i + 1 < argc) {
+			i++;
+			continue;
+		}
+		args[n++] = argv[i];
+	}
+
+	snprintf(fd_arg, sizeof(fd_arg), "%d", mpd_fd);
+	args[n++] = "-R";
+	args[n++] = fd_arg;
+	args[n] = NULL;
+
+	nfds = getdtablesize();
+	for (fd = STDERR_FILENO + 1; fd < nfds; fd++)
+		if (fd != mpd_fd)
+			fcntl(fd, F_SETFD, FD_CLOEXEC);
+
 	fflush(stdout);
+	execvp(args[0], args);
+	warn("cannot re-execute %s", args[0]);
+	free(args);
+}
+
+static void
+usage()
+{
+	fprintf(stderr, "usage: lemonbar-status [-j] [-r trace]\n"
+	    "       lemonbar-status [-j] -p trace [-s speed]\n");
+	exit(1);
 }
 
 int
-main()
+main(int argc, char *argv[])
 {
-	char *infos[INFO_ARRAY_SIZE], c;
-	struct kevent kev_in[EVENTS], kev[EVENTS];
-	int kq, nev, i, mail_fd, weather_fd, clock_update, n, pipe_fd[2],
-            mpd_fd;
-	
+	char *infos[INFO_ARRAY_SIZE], c, *record, *replay, *ep, path[PATH_MAX];
+	struct kevent kev_in[CHANGES], kev[EVENTS];
+	int kq, nev, i, j, mail_fd, weather_fd, clock_update, n, pipe_fd[2],
+            mpd_fd, query_fd, command_fd, fd, script_fds[EVENTS],
+            scripts, had_scripts, script_timer, nfds, route_fd, netrate_timer,
+            thermal_update, fs_update, marquee_timer, worker_fd,
+            weather_job, brightness_job, window_job, window_timer,
+            weather_dir_fd, health_timer, resumed, config_fd, config_dir_fd,
+            reload, changes, x, randr, audio, weather_fetch, fetch_fd,
+            fetch_res, ticks, ch;
+	double speed;
+
+	record = replay = NULL;
+	speed = 0;
+	marquee_timer = 0;
+	resumed = 0;
+	mpd_fd = -1;
+
+	while ((ch = getopt(argc, argv, "jp:r:s:R:")) != -1) {
+		switch (ch) {
+		case 'j':
+			i3bar = 1;
+			break;
+		case 'p':
+			replay = optarg;
+			break;
+		case 'r':
+			record = optarg;
+			break;
+		case 's':
+			speed = strtod(optarg, &ep);
+			if (*optarg == '\0' || *ep != '\0' || speed < 0)
+				usage();
+			break;
+		case 'R':
+			mpd_fd = strtol(optarg, &ep, 10);
+			if (*optarg == '\0' || *ep != '\0' || mpd_fd < -1)
+				usage();
+			resumed = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || (replay && record))
+		usage();
+
+	/* every frame depends on the layout */
+	config_fd = config_init(&config_dir_fd);
+	reload = 0;
+
+	if (i3bar)
+		i3bar_init(resumed);
+
+	/* a replay only exercises the formatting and output path */
+	if (replay) {
+		trace_replay(replay, speed, infos, output_status);
+		return 0;
+	}
+
+	if (record)
+		trace_record_open(record, resumed);
+
 	bzero(infos, INFO_ARRAY_SIZE * sizeof(char *));
 	n = 0;
 
+        /* Configuration, an editor may replace the file */
+
+	if (config_fd >= 0)
+		EV_SET(&kev_in[n++], config_fd, EVFILT_VNODE, EV_ADD | EV_CLEAR,
+		    NOTE_WRITE | NOTE_DELETE | NOTE_RENAME, 0, NULL);
+	if (config_dir_fd >= 0)
+		EV_SET(&kev_in[n++], config_dir_fd, EVFILT_VNODE,
+		    EV_ADD | EV_CLEAR, NOTE_WRITE, 0, NULL);
+
+        /* Commands */
+
+	if ((command_fd = command_init(i3bar)) >= 0) {
+		clickable = !i3bar;
+		EV_SET(&kev_in[n++], command_fd, EVFILT_READ, EV_ADD, 0, 0,
+		    NULL);
+	}
+
+        /* Re-exec, started by SIGHUP; the first frame is the last one */
+
+	/* without the values MPD is connected again */
+	if (resumed && !resume(infos, mpd_fd) && mpd_fd >= 0) {
+		close(mpd_fd);
+		mpd_fd = -1;
+	}
+
+	signal(SIGHUP, SIG_IGN);
+	EV_SET(&kev_in[n++], SIGHUP, EVFILT_SIGNAL, EV_ADD, 0, 0, NULL);
+
+        /* Worker pool for sources which may block */
+
+	if ((worker_fd = worker_init()) >= 0)
+		EV_SET(&kev_in[n++], worker_fd, EVFILT_READ, EV_ADD, 0, 0,
+		    NULL);
+	weather_job = worker_add(INFO_WEATHER, weather_read,
+	    &status.weather, sizeof(status.weather));
+	brightness_job = window_job = -1;
+	window_timer = x = randr = audio = 0;
+
         /* Mail */
 
 	if ((mail_fd = mail_init()) >= 0) {
@@ -132,51 +511,87 @@ main()
 		    0, NULL);
 	}
 
-       /* MPD */
+       /* MPD, unless the connection was handed over */
 
-        if ((mpd_fd = mpd_init()) >= 0) {
-                infos[INFO_MPD] = mpd_info(mpd_fd);
-                mpd_idle_start(mpd_fd);
-		EV_SET(&kev_in[n++], mpd_fd, EVFILT_READ, EV_ADD |
-		    EV_CLEAR, 0, 0, NULL);
-        }
+        if (mpd_fd >= 0 || (mpd_fd = mpd_connect(infos)) >= 0)
+                EV_SET(&kev_in[n++], mpd_fd, EVFILT_READ, EV_ADD |
+                    EV_CLEAR, 0, 0, NULL);
+
+        /* the connection is retried while it is down */
+	health_timer = mpd_fd < 0;
+	if (health_timer)
+		EV_SET(&kev_in[n++], HEALTH_TIMER, EVFILT_TIMER, EV_ADD, 0,
+		    HEALTH_INTERVAL, NULL);
         
-        /* Weather */
+        /* Weather, fetched or from the files of the weather script */
 
-        if ((weather_fd = weather_init()) >= 0) {
-                infos[INFO_WEATHER] = weather_info();
-		EV_SET(&kev_in[n++], weather_fd, EVFILT_VNODE,
-		    EV_ADD | EV_CLEAR, NOTE_WRITE, 0, NULL);
-        }
+	weather_fd = weather_dir_fd = fetch_fd = -1;
+	if ((weather_fetch = weather_fetch_init())) {
+		infos[INFO_WEATHER] = weather_fetch_info();
+		EV_SET(&kev_in[n++], WEATHER_TIMER, EVFILT_TIMER,
+		    EV_ADD | EV_ONESHOT, 0, weather_fetch_delay(), NULL);
+	} else {
+		/* the directory shows a replaced file */
+		if ((weather_fd = weather_init()) >= 0) {
+			infos[INFO_WEATHER] = weather_info();
+			EV_SET(&kev_in[n++], weather_fd, EVFILT_VNODE,
+			    EV_ADD | EV_CLEAR, NOTE_WRITE | NOTE_DELETE |
+			    NOTE_RENAME, 0, NULL);
+		}
+		if ((weather_dir_fd = weather_dir()) >= 0)
+			EV_SET(&kev_in[n++], weather_dir_fd, EVFILT_VNODE,
+			    EV_ADD | EV_CLEAR, NOTE_WRITE, 0, NULL);
+	}
 
         if (pipe(pipe_fd) == -1) {
                 warn("could not open pipe");
         } else {
 
-                /* Brightness */
+                /* Brightness, keyboard and window */
 
-                if (x_init(pipe_fd[1])) {
+                if ((x = x_init(pipe_fd[1]))) {
 
-                        infos[INFO_BRIGHTNESS] = x_info();
+                        infos[INFO_KEYBOARD] = x_keyboard_info();
+                        infos[INFO_WINDOW] = x_window_info();
+                        window_job = worker_add(INFO_WINDOW, x_window_read,
+                            &status.window, sizeof(status.window));
 
-                        EV_SET(&kev_in[n++], BRIGHTNESS_TIMER, EVFILT_TIMER,
-                            EV_ADD, 0, BRIGHTNESS_INTERVAL, NULL);
+                        if ((randr = x_brightness())) {
+                                infos[INFO_BRIGHTNESS] = x_info();
+                                brightness_job = worker_add(INFO_BRIGHTNESS,
+                                    x_read, &status.brightness,
+                                    sizeof(status.brightness));
+                                EV_SET(&kev_in[n++], BRIGHTNESS_TIMER,
+                                    EVFILT_TIMER, EV_ADD, 0, config->
+                                    intervals[INTERVAL_BRIGHTNESS], NULL);
+                        }
                         EV_SET(&kev_in[n++], pipe_fd[0], EVFILT_READ,
                                 EV_ADD, 0, 0, NULL);
                 }
 
                 /* Audio */
 
-                if (audio_init()) {
+                if ((audio = audio_init())) {
                         infos[INFO_AUDIO] = audio_info();
 
                         EV_SET(&kev_in[n++], AUDIO_TIMER, EVFILT_TIMER,
-                            EV_ADD, 0, AUDIO_INTERVAL, NULL);
+                            EV_ADD, 0, config->intervals[INTERVAL_AUDIO],
+                            NULL);
                         EV_SET(&kev_in[n++], pipe_fd[0], EVFILT_READ,
                             EV_ADD, 0, 0, NULL);
                 }
         }
 
+        /* Brightness without RandR, the console reports no changes */
+
+	if (brightness_job == -1 && backlight_init()) {
+		infos[INFO_BRIGHTNESS] = backlight_info();
+		brightness_job = worker_add(INFO_BRIGHTNESS, backlight_read,
+		    &status.brightness, sizeof(status.brightness));
+		EV_SET(&kev_in[n++], BRIGHTNESS_TIMER, EVFILT_TIMER, EV_ADD, 0,
+		    BACKLIGHT_INTERVAL, NULL);
+	}
+
         /* Clock */
 
 	infos[INFO_CLOCK] = clock_info(&clock_update);
@@ -189,18 +604,87 @@ main()
 	infos[INFO_BATTERY] = battery_info();
 
 	EV_SET(&kev_in[n++], BATTERY_TIMER, EVFILT_TIMER, EV_ADD, 0,
-	    BATTERY_INTERVAL, NULL);
+	    config->intervals[INTERVAL_BATTERY], NULL);
 
         /* Network */
 
 	infos[INFO_NETWORK] = net_info();
 
 	EV_SET(&kev_in[n++], NET_TIMER, EVFILT_TIMER, EV_ADD, 0,
-	    NET_INTERVAL, NULL);
+	    config->intervals[INTERVAL_NET], NULL);
+
+        /* Network throughput */
+
+	netrate_timer = 0;
+	if ((route_fd = netrate_init()) >= 0) {
+		EV_SET(&kev_in[n++], route_fd, EVFILT_READ, EV_ADD, 0, 0,
+		    NULL);
+		if (netrate_up()) {
+			netrate_timer = 1;
+			EV_SET(&kev_in[n++], NETRATE_TIMER, EVFILT_TIMER,
+			    EV_ADD, 0, config->intervals[INTERVAL_NETRATE],
+			    NULL);
+		}
+	}
+
+        /* CPU, memory and load */
+
+	cpu_info();
+	infos[INFO_MEMORY] = memory_info();
+	infos[INFO_LOAD] = load_info();
+
+	EV_SET(&kev_in[n++], SYSTEM_TIMER, EVFILT_TIMER, EV_ADD, 0,
+	    config->intervals[INTERVAL_SYSTEM], NULL);
+
+        /* Temperature and fan */
+
+	if (thermal_init()) {
+		infos[INFO_THERMAL] = thermal_info(&thermal_update);
+		EV_SET(&kev_in[n++], THERMAL_TIMER, EVFILT_TIMER, EV_ADD, 0,
+		    thermal_update, NULL);
+	}
+
+        /* File systems */
+
+	if (fs_init()) {
+		infos[INFO_FS] = fs_info(&fs_update);
+		EV_SET(&kev_in[n++], FS_TIMER, EVFILT_TIMER, EV_ADD, 0,
+		    fs_update, NULL);
+	}
+
+        /* Scripts */
+
+	scripts = script_init() > 0;
+	if (scripts && script_timeout(&script_timer))
+		EV_SET(&kev_in[n++], SCRIPT_TIMER, EVFILT_TIMER, EV_ADD, 0,
+		    script_timer, NULL);
+
+        /* Query socket */
+
+	if ((query_fd = query_init()) >= 0)
+		EV_SET(&kev_in[n++], query_fd, EVFILT_READ, EV_ADD, 0, 0,
+		    NULL);
+
+        /* Shared memory snapshot and history */
+
+	if (snapshot_path(path, sizeof(path)))
+		snapshot_init(path);
+	else
+		warn("no place for the snapshot");
+	history_init();
 
         /* Event Loop */
 
 	output_status(infos);
+	trace_frame(infos);
+	snapshot_publish(infos);
+	history_record();
+
+	if (marquee_active(infos)) {
+		marquee_timer = 1;
+		EV_SET(&kev_in[n++], MARQUEE_TIMER, EVFILT_TIMER, EV_ADD, 0,
+		    MARQUEE_INTERVAL, NULL);
+	}
 
 	if ((kq = kqueue()) < 0)
 		err(1, "cannot create kqueue");
@@ -214,23 +698,46 @@ main()
 		if (nev == 0)
 			continue;
 
+		ticks = 0;
 		for (i = 0; i < nev; i++) {
 
 			if (kev[i].flags & EV_ERROR)
 				errx(1, "%s",
 				    strerror(kev[i].data));
 
+			trace_event(kev[i].ident, kev[i].filter);
+
 			switch (kev[i].filter) {
 
+			case EVFILT_SIGNAL:
+				reexec(argc, argv, mpd_fd);
+				break;
+
 			case EVFILT_VNODE:
 
 				if (kev[i].ident == (uintptr_t)mail_fd)
 					infos[INFO_MAIL] =
 					    mail_info(mail_fd);
+				else if (kev[i].ident == (uintptr_t)config_fd ||
+				    kev[i].ident == (uintptr_t)config_dir_fd)
+					reload = 1;
 				else if (kev[i].ident ==
+				    (uintptr_t)weather_dir_fd ||
+				    (kev[i].ident == (uintptr_t)weather_fd &&
+				    kev[i].fflags & (NOTE_DELETE |
+				    NOTE_RENAME))) {
+					/* watch the replacing file */
+					if (!weather_reopen(&weather_fd) ||
+					    weather_fd < 0)
+						break;
+					EV_SET(&kev_in[n++], weather_fd,
+					    EVFILT_VNODE, EV_ADD | EV_CLEAR,
+					    NOTE_WRITE | NOTE_DELETE |
+					    NOTE_RENAME, 0, NULL);
+					worker_request(weather_job, infos);
+				} else if (kev[i].ident ==
 				    (uintptr_t)weather_fd)
-					infos[INFO_WEATHER] =
-					    weather_info();
+					worker_request(weather_job, infos);
 				break;
 
 			case EVFILT_TIMER:
@@ -249,51 +756,368 @@ main()
 					break;
 
 				case BATTERY_TIMER:
-					infos[INFO_BATTERY] =
-					    battery_info();
+					if (health_due(HEALTH_BATTERY))
+						infos[INFO_BATTERY] =
+						    battery_info();
 					break;
 
 				case NET_TIMER:
-					infos[INFO_NETWORK] =
-					    net_info();
+					if (health_due(HEALTH_NET))
+						infos[INFO_NETWORK] =
+						    net_info();
+					break;
+
+				case HEALTH_TIMER:
+					if (mpd_fd >= 0 ||
+					    !health_due(HEALTH_MPD))
+						break;
+					if ((mpd_fd = mpd_connect(infos)) >= 0)
+						EV_SET(&kev_in[n++], mpd_fd,
+						    EVFILT_READ, EV_ADD |
+						    EV_CLEAR, 0, 0, NULL);
 					break;
 
 				case BRIGHTNESS_TIMER:
-					infos[INFO_BRIGHTNESS] = x_info();
+					worker_request(brightness_job, infos);
 					break;
 				case AUDIO_TIMER:
 					infos[INFO_AUDIO] =
 					    audio_info();
 					break;
+
+				case NETRATE_TIMER:
+					infos[INFO_NETRATE] = netrate_info();
+					break;
+
+				case THERMAL_TIMER:
+					infos[INFO_THERMAL] =
+					    thermal_info(&thermal_update);
+					EV_SET(&kev_in[n++], THERMAL_TIMER,
+					    EVFILT_TIMER, EV_DELETE, 0, 0,
+					    NULL);
+					EV_SET(&kev_in[n++],
+					    THERMAL_TIMER, EVFILT_TIMER,
+					    EV_ADD, 0, thermal_update, NULL);
+					break;
+
+				case FS_TIMER:
+					infos[INFO_FS] = fs_info(&fs_update);
+					EV_SET(&kev_in[n++], FS_TIMER,
+					    EVFILT_TIMER, EV_DELETE, 0, 0,
+					    NULL);
+					EV_SET(&kev_in[n++],
+					    FS_TIMER, EVFILT_TIMER,
+					    EV_ADD, 0, fs_update, NULL);
+					break;
+
+				case SYSTEM_TIMER:
+					infos[INFO_CPU] = cpu_info();
+					infos[INFO_MEMORY] = memory_info();
+					infos[INFO_LOAD] = load_info();
+					break;
+
+				case WEATHER_TIMER:
+					/* a running request has timed out */
+					if (fetch_fd >= 0) {
+						weather_fetch_cancel(fetch_fd);
+						fetch_fd = -1;
+					} else if (health_due(HEALTH_WEATHER) &&
+					    (fetch_fd = weather_fetch_start())
+					    >= 0) {
+						EV_SET(&kev_in[n++], fetch_fd,
+						    EVFILT_WRITE, EV_ADD |
+						    EV_ONESHOT, 0, 0, NULL);
+						EV_SET(&kev_in[n++], fetch_fd,
+						    EVFILT_READ, EV_ADD, 0, 0,
+						    NULL);
+					}
+					EV_SET(&kev_in[n++], WEATHER_TIMER,
+					    EVFILT_TIMER, EV_ADD | EV_ONESHOT, 0,
+					    fetch_fd >= 0 ? HTTP_TIMEOUT :
+					    weather_fetch_delay(), NULL);
+					break;
+
+				case WINDOW_TIMER:
+					window_timer = 0;
+					worker_request(window_job, infos);
+					break;
+
+				case MARQUEE_TIMER:
+					marquee_step();
+					ticks++;
+					break;
+
+				case SCRIPT_TIMER:
+					nfds = script_run(script_fds, EVENTS);
+					for (j = 0; j < nfds; j++)
+						EV_SET(&kev_in[n++],
+						    script_fds[j], EVFILT_READ,
+						    EV_ADD, 0, 0, NULL);
+					break;
 				}
 				break;
 
+			case EVFILT_WRITE:
+				/* only the weather request is written to */
+				/* FALLTHROUGH */
 			case EVFILT_READ:
-				if (kev[i].ident ==
+				if (kev[i].ident == (uintptr_t)fetch_fd) {
+					if ((fetch_res = weather_fetch_event(
+					    &fetch_fd, kev[i].filter)) ==
+					    HTTP_PENDING)
+						break;
+					/* the next address of the server */
+					if (fetch_res == HTTP_RETRY) {
+						EV_SET(&kev_in[n++], fetch_fd,
+						    EVFILT_WRITE, EV_ADD |
+						    EV_ONESHOT, 0, 0, NULL);
+						EV_SET(&kev_in[n++], fetch_fd,
+						    EVFILT_READ, EV_ADD, 0, 0,
+						    NULL);
+						break;
+					}
+					fetch_fd = -1;
+					infos[INFO_WEATHER] =
+					    weather_fetch_info();
+					EV_SET(&kev_in[n++], WEATHER_TIMER,
+					    EVFILT_TIMER, EV_ADD | EV_ONESHOT, 0,
+					    weather_fetch_delay(), NULL);
+				} else if (kev[i].ident ==
 				    (uintptr_t)pipe_fd[0]) {
 					read(pipe_fd[0], &c, 1);
+					trace_byte(c);
 					switch (c) {
 					case BRIGHTNESS_EVENT:
-						infos[INFO_BRIGHTNESS] =
-						    x_info();
+						worker_request(brightness_job,
+						    infos);
+						break;
+					case AUDIO_MUTE_EVENT:
+						infos[INFO_AUDIO] =
+						    audio_toggle_mute();
+						break;
+					case AUDIO_DOWN_EVENT:
+						infos[INFO_AUDIO] =
+						    audio_step(-1);
 						break;
-					case AUDIO_EVENT:
+					case AUDIO_UP_EVENT:
 						infos[INFO_AUDIO] =
-						    audio_info();
+						    audio_step(1);
+						break;
+					case WINDOW_EVENT:
+						/* fetch once after a burst */
+						if (window_timer)
+							break;
+						window_timer = 1;
+						EV_SET(&kev_in[n++],
+						    WINDOW_TIMER, EVFILT_TIMER,
+						    EV_ADD | EV_ONESHOT, 0,
+						    WINDOW_DELAY, NULL);
+						break;
+					case KEYMAP_EVENT:
+						x_keyboard_names();
+						/* FALLTHROUGH */
+					case KEYBOARD_EVENT:
+						infos[INFO_KEYBOARD] =
+						    x_keyboard_info();
 						break;
 					}
 				} else if (kev[i].ident ==
                                     (uintptr_t)mpd_fd) {
-                                            mpd_idle_end(mpd_fd);
-                                            infos[INFO_MPD] =
-                                                mpd_info(mpd_fd);
-                                            mpd_idle_start(mpd_fd);
-                                }
+                                        /* a failed connection is dropped */
+                                        if (mpd_idle_end(mpd_fd) == -1 ||
+                                            (infos[INFO_MPD] =
+                                            mpd_info(mpd_fd)) == NULL) {
+                                                infos[INFO_MPD] = NULL;
+                                                mpd_close(mpd_fd);
+                                                mpd_fd = -1;
+                                        } else
+                                                mpd_idle_start(mpd_fd);
+                                } else if (kev[i].ident ==
+				    (uintptr_t)worker_fd) {
+					worker_collect(worker_fd, infos);
+				} else if (kev[i].ident ==
+				    (uintptr_t)query_fd) {
+					if ((fd = query_accept(query_fd))
+					    >= 0)
+						EV_SET(&kev_in[n++], fd,
+						    EVFILT_READ, EV_ADD, 0, 0,
+						    NULL);
+				} else if (kev[i].ident ==
+				    (uintptr_t)command_fd) {
+					if (command_read(command_fd, &mpd_fd,
+					    infos) == -1) {
+						close(command_fd);
+						command_fd = -1;
+					}
+				} else if (kev[i].ident ==
+				    (uintptr_t)route_fd) {
+					if (netrate_route(route_fd))
+						infos[INFO_NETWORK] =
+						    net_info();
+				} else if (script_is_fd(kev[i].ident)) {
+					if (script_read(kev[i].ident))
+						infos[INFO_SCRIPTS] =
+						    script_info();
+				} else if (query_is_client(kev[i].ident))
+					query_read(kev[i].ident);
 
 				break;
 			}
 		}
+
+		/* a scroll step changes nothing but the scrolling segments */
+		if (ticks == nev) {
+			output_scroll(infos);
+			continue;
+		}
+
+		/* re-initialize only the sources whose settings changed */
+		if (reload) {
+			reload = 0;
+			changes = config_reload(&config_fd);
+			if (config_fd >= 0)
+				EV_SET(&kev_in[n++], config_fd, EVFILT_VNODE,
+				    EV_ADD | EV_CLEAR, NOTE_WRITE | NOTE_DELETE |
+				    NOTE_RENAME, 0, NULL);
+
+			if (changes & CONFIG_NET)
+				infos[INFO_NETWORK] = net_info();
+			if (changes & CONFIG_OUTPUT && randr && x_output())
+				worker_request(brightness_job, infos);
+			if (changes & CONFIG_KEYS && x)
+				x_keys();
+
+			if (changes & CONFIG_WEATHER) {
+				if (weather_fd >= 0)
+					close(weather_fd);
+				if (weather_dir_fd >= 0)
+					close(weather_dir_fd);
+				if (fetch_fd >= 0)
+					http_close(fetch_fd);
+				weather_fd = weather_dir_fd = fetch_fd = -1;
+				/* armed all the time while fetching */
+				if (weather_fetch)
+					EV_SET(&kev_in[n++], WEATHER_TIMER,
+					    EVFILT_TIMER, EV_DELETE, 0, 0, NULL);
+
+				if ((weather_fetch = weather_fetch_init())) {
+					infos[INFO_WEATHER] =
+					    weather_fetch_info();
+					EV_SET(&kev_in[n++], WEATHER_TIMER,
+					    EVFILT_TIMER, EV_ADD | EV_ONESHOT, 0,
+					    weather_fetch_delay(), NULL);
+				} else {
+					if ((weather_fd = weather_init()) >= 0)
+						EV_SET(&kev_in[n++], weather_fd,
+						    EVFILT_VNODE, EV_ADD |
+						    EV_CLEAR, NOTE_WRITE |
+						    NOTE_DELETE | NOTE_RENAME,
+						    0, NULL);
+					if ((weather_dir_fd = weather_dir())
+					    >= 0)
+						EV_SET(&kev_in[n++],
+						    weather_dir_fd, EVFILT_VNODE,
+						    EV_ADD | EV_CLEAR, NOTE_WRITE,
+						    0, NULL);
+					worker_request(weather_job, infos);
+				}
+			}
+
+			if (changes & CONFIG_SCRIPTS) {
+				had_scripts = scripts;
+				scripts = script_reload() > 0;
+				infos[INFO_SCRIPTS] = script_info();
+				/* the timer is only armed with commands */
+				if (had_scripts && !scripts)
+					EV_SET(&kev_in[n++], SCRIPT_TIMER,
+					    EVFILT_TIMER, EV_DELETE, 0, 0, NULL);
+				else if (!had_scripts && scripts &&
+				    script_timeout(&script_timer))
+					EV_SET(&kev_in[n++], SCRIPT_TIMER,
+					    EVFILT_TIMER, EV_ADD, 0,
+					    script_timer, NULL);
+			}
+
+			if (changes & CONFIG_MPD) {
+				if (mpd_fd >= 0)
+					mpd_close(mpd_fd);
+				infos[INFO_MPD] = NULL;
+				if ((mpd_fd = mpd_connect(infos)) >= 0)
+					EV_SET(&kev_in[n++], mpd_fd,
+					    EVFILT_READ, EV_ADD | EV_CLEAR, 0,
+					    0, NULL);
+			}
+
+			/* EV_ADD changes the period of an existing timer */
+			if (changes & CONFIG_INTERVALS) {
+				EV_SET(&kev_in[n++], BATTERY_TIMER,
+				    EVFILT_TIMER, EV_ADD, 0,
+				    config->intervals[INTERVAL_BATTERY], NULL);
+				EV_SET(&kev_in[n++], NET_TIMER, EVFILT_TIMER,
+				    EV_ADD, 0, config->intervals[INTERVAL_NET],
+				    NULL);
+				EV_SET(&kev_in[n++], SYSTEM_TIMER,
+				    EVFILT_TIMER, EV_ADD, 0,
+				    config->intervals[INTERVAL_SYSTEM], NULL);
+				if (audio)
+					EV_SET(&kev_in[n++], AUDIO_TIMER,
+					    EVFILT_TIMER, EV_ADD, 0,
+					    config->intervals[INTERVAL_AUDIO],
+					    NULL);
+				if (randr)
+					EV_SET(&kev_in[n++], BRIGHTNESS_TIMER,
+					    EVFILT_TIMER, EV_ADD, 0, config->
+					    intervals[INTERVAL_BRIGHTNESS], NULL);
+				if (netrate_timer)
+					EV_SET(&kev_in[n++], NETRATE_TIMER,
+					    EVFILT_TIMER, EV_ADD, 0, config->
+					    intervals[INTERVAL_NETRATE], NULL);
+				if (weather_fetch && fetch_fd < 0)
+					EV_SET(&kev_in[n++], WEATHER_TIMER,
+					    EVFILT_TIMER, EV_ADD | EV_ONESHOT, 0,
+					    weather_fetch_delay(), NULL);
+			}
+		}
+
+		/* sample the throughput only while the link is up */
+		if (route_fd >= 0 && netrate_up() != netrate_timer) {
+			netrate_timer = !netrate_timer;
+			EV_SET(&kev_in[n++], NETRATE_TIMER, EVFILT_TIMER,
+			    netrate_timer ? EV_ADD : EV_DELETE, 0,
+			    config->intervals[INTERVAL_NETRATE], NULL);
+			if (!netrate_timer)
+				infos[INFO_NETRATE] = NULL;
+		}
+
+		/* retry MPD only while it is disconnected */
+		if ((mpd_fd < 0) != health_timer) {
+			health_timer = !health_timer;
+			EV_SET(&kev_in[n++], HEALTH_TIMER, EVFILT_TIMER,
+			    health_timer ? EV_ADD : EV_DELETE, 0,
+			    HEALTH_INTERVAL, NULL);
+		}
+
+		/* re-arm the script timer if the next deadline has moved */
+		if (scripts && script_timeout(&script_timer)) {
+			EV_SET(&kev_in[n++], SCRIPT_TIMER, EVFILT_TIMER,
+			    EV_DELETE, 0, 0, NULL);
+			EV_SET(&kev_in[n++], SCRIPT_TIMER, EVFILT_TIMER,
+			    EV_ADD, 0, script_timer, NULL);
+		}
+
 		output_status(infos);
+		trace_frame(infos);
+		snapshot_publish(infos);
+		history_record();
+		query_notify();
+
+		/* scroll only while a long element is displayed and active */
+		if (marquee_active(infos) != marquee_timer) {
+			marquee_timer = !marquee_timer;
+			EV_SET(&kev_in[n++], MARQUEE_TIMER, EVFILT_TIMER,
+			    marquee_timer ? EV_ADD : EV_DELETE, 0,
+			    MARQUEE_INTERVAL, NULL);
+		}
 	}
 
 cleanup_1:
@@ -0,0 +1,267 @@
+#include <string.h>
+
+#include "config.h"
+#include "marquee.h"
+#include "status.h"
+
+#define MARQUEE_BUFLEN 512	/* longer than every element */
+#define MARQUEE_GAP "   "
+#define MARQUEE_ELLIPSIS "…"
+
+/* Is the byte the start of a UTF-8 sequence? */
+#define UTF8_START(c) (((unsigned char)(c) & 0xc0) != 0x80)
+
+/*
+ * A segment limited to width codepoints. Longer text is either cut off
+ * or, if scroll is set and the text contains no formatting tags,
+ * scrolled through while the segment is active.
+ */
+struct marquee {
+	int		 info;
+	int		 width;
+	int		 scroll;
+	int		(*active)();
+
+	char		 text[MARQUEE_BUFLEN];	/* as formatted by *_info() */
+	int		 length;		/* codepoints of text */
+	int		 scrolling;
+	char		 cut[MARQUEE_BUFLEN];
+
+	/* text, gap and text again, so every window is contiguous */
+	char		 ring[2 * MARQUEE_BUFLEN + sizeof(MARQUEE_GAP)];
+	unsigned short	 offsets[2 * MARQUEE_BUFLEN + sizeof(MARQUEE_GAP)];
+	int		 period;		/* codepoints of text and gap */
+	int		 pos;
+	char		 window[MARQUEE_BUFLEN];
+};
+
+static int	marquee_mpd_playing();
+
+/* Is the segment scrolled through at the moment? */
+#define MARQUEE_MOVING(m) ((m)->scrolling && ((m)->active == NULL || \
+	(m)->active()))
+
+static struct marquee marquees[] = {
+	{ INFO_WINDOW,	40,	0,	NULL },
+	{ INFO_MPD,	48,	1,	marquee_mpd_playing },
+	{ INFO_SCRIPTS,	40,	0,	NULL },
+	{ INFO_WEATHER,	32,	0,	NULL }
+};
+
+#define NMARQUEES ((int)(sizeof(marquees) / sizeof(marquees[0])))
+
+static struct marquee *marquee_find(int);
+static void	marquee_load(struct marquee *, const char *);
+static void	marquee_window(struct marquee *);
+static int	marquee_tag(const char *);
+
+/*
+ * Returns the text to be displayed for the element info. The
+ * codepoint offsets are only computed again if str has changed.
+ */
+char *
+marquee_apply(int info, char *str)
+{
+	struct marquee *m;
+
+	if ((m = marquee_find(info)) == NULL || str == NULL)
+		return str;
+
+	if (strcmp(str, m->text) != 0)
+		marquee_load(m, str);
+
+	if (m->length <= m->width)
+		return str;
+	if (!MARQUEE_MOVING(m)) {
+		if (m->pos != 0) {
+			m->pos = 0;
+			marquee_window(m);
+		}
+		return m->cut;
+	}
+
+	return m->window;
+}
+
+/* Is the element info displayed as a scrolling window? */
+int
+marquee_scrolling(int info)
+{
+	struct marquee *m;
+
+	return (m = marquee_find(info)) != NULL && MARQUEE_MOVING(m);
+}
+
+/*
+ * Does any segment have to be scrolled? Only segments which are part
+ * of the current line count, a stale text of a source which has gone
+ * away must not keep the timer running.
+ */
+int
+marquee_active(char *infos[])
+{
+	struct marquee *m;
+	int i;
+
+	for (i = 0; i < NMARQUEES; i++) {
+		m = &marquees[i];
+		if (MARQUEE_MOVING(m) && infos[m->info] != NULL &&
+		    strcmp(infos[m->info], m->text) == 0 &&
+		    memchr(config->order, m->info, config->norder) != NULL)
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Moves every scrolling segment on by one codepoint. */
+void
+marquee_step()
+{
+	struct marquee *m;
+	int i;
+
+	for (i = 0; i < NMARQUEES; i++) {
+		m = &marquees[i];
+		if (!MARQUEE_MOVING(m))
+			continue;
+		m->pos = (m->pos + 1) % m->period;
+		marquee_window(m);
+	}
+}
+
+static struct marquee *
+marquee_find(int info)
+{
+	int i;
+
+	for (i = 0; i < NMARQUEES; i++)
+		if (marquees[i].info == info)
+			return &marquees[i];
+
+	return NULL;
+}
+
+static int
+marquee_mpd_playing()
+{
+	return status.mpd.state == MPD_STATE_PLAY;
+}
+
+/*
+ * Returns the length of a lemonbar formatting tag at str, or 0. The
+ * callers skip escaped percent signs, so "%%{" is no tag.
+ */
+static int
+marquee_tag(const char *str)
+{
+	const char *end;
+
+	if (str[0] != '%' || str[1] != '{' ||
+	    (end = strchr(str + 2, '}')) == NULL)
+		return 0;
+
+	return end - str + 1;
+}
+
+/* Removes a UTF-8 sequence which was cut off at the end of str. */
+void
+marquee_trim(char *str)
+{
+	unsigned char c;
+	size_t len, n, need;
+
+	len = strlen(str);
+	for (n = len; n > 0 && !UTF8_START(str[n - 1]); n--)
+		;
+	if (n == 0)
+		return;
+
+	c = str[n - 1];
+	need = c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 1;
+	if (len - (n - 1) < need)
+		str[n - 1] = '\0';
+}
+
+/*
+ * Counts the codepoints of a new text, prepares the cut off version
+ * and, for scrolling segments, the offsets of all codepoints.
+ */
+static void
+marquee_load(struct marquee *m, const char *str)
+{
+	const char *p;
+	size_t n;
+	int len, plain, tag;
+
+	if (strlcpy(m->text, str, sizeof(m->text)) >= sizeof(m->text))
+		marquee_trim(m->text);
+
+	m->length = 0;
+	plain = 1;
+	for (p = m->text; *p != '\0'; p++) {
+		if ((tag = marquee_tag(p)) > 0) {
+			plain = 0;
+			p += tag - 1;
+		} else if (UTF8_START(*p))
+			m->length++;
+		if (p[0] == '%' && p[1] == '%') {
+			plain = 0;	/* an escaped percent sign */
+			p++;
+		}
+	}
+
+	m->pos = 0;
+	m->scrolling = 0;
+	if (m->length <= m->width)
+		return;
+
+	/* leave room for the ellipsis, formatting tags are kept */
+	len = 0;
+	for (p = m->text; *p != '\0'; p++) {
+		if ((tag = marquee_tag(p)) > 0) {
+			p += tag - 1;
+			continue;
+		}
+		if (UTF8_START(*p) && ++len == m->width)
+			break;
+		if (p[0] == '%' && p[1] == '%')
+			p++;
+	}
+	n = p - m->text;
+	memcpy(m->cut, m->text, n);
+	m->cut[n] = '\0';
+	strlcat(m->cut, MARQUEE_ELLIPSIS, sizeof(m->cut));
+
+	if (!m->scroll || !plain)
+		return;
+
+	n = strlcpy(m->ring, m->text, sizeof(m->ring));
+	n += strlcpy(m->ring + n, MARQUEE_GAP, sizeof(m->ring) - n);
+	strlcpy(m->ring + n, m->text, sizeof(m->ring) - n);
+
+	len = 0;
+	for (p = m->ring; *p != '\0'; p++)
+		if (UTF8_START(*p))
+			m->offsets[len++] = p - m->ring;
+	m->offsets[len] = p - m->ring;
+
+	m->period = m->length + sizeof(MARQUEE_GAP) - 1;
+	m->scrolling = 1;
+	marquee_window(m);
+}
+
+/* Copies the width codepoints starting at the current position. */
+static void
+marquee_window(struct marquee *m)
+{
+	size_t start, len;
+
+	if (!m->scrolling)
+		return;
+
+	start = m->offsets[m->pos];
+	len = m->offsets[m->pos + m->width] - start;
+	memcpy(m->window, m->ring + start, len);
+	m->window[len] = '\0';
+}
@@ -0,0 +1,7 @@
+#define MARQUEE_INTERVAL 400
+
+char   *marquee_apply(int, char *);
+int     marquee_scrolling(int);
+int     marquee_active(char **);
+void    marquee_step();
+void    marquee_trim(char *);
@@ -0,0 +1,479 @@
+/*
+ * mpd-bench -- runs the MPD client against a scripted stand-in server
+ *
+ * usage: mpd-bench [-f script]
+ *
+ * A thread plays a local MPD server which speaks just enough of the
+ * text protocol for mpd.c: the greeting, idle and noidle, status,
+ * currentsong and outputs. It announces song changes, and the client
+ * code of lemonbar-status follows them like the event loop does. For
+ * every change the time from the notification to the formatted
+ * element, and the number of changes per second, are reported.
+ *
+ * The script sets the conditions and runs scenarios with them, one
+ * command per line; settings stay in effect for later runs:
+ *
+ *	changes n	song changes per run
+ *	interval ms	between changes, 0 as soon as the client is idle
+ *	title len	length of the Title tag
+ *	split bytes	responses are sent in pieces of at most bytes
+ *	delay ms	every response is delayed
+ *	disconnect n	the connection is dropped instead of every n-th
+ *			change notification, 0 never
+ *	stream 0|1	a radio stream: only the Title tag changes under
+ *			the same song id, announced as a player change
+ *	run name	runs a scenario
+ *
+ * Without a script the built-in one below is run. Exits with 1 if the
+ * client has lost a change, stalled or formatted a wrong element.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "mpd.h"
+#include "status.h"
+
+#define BENCH_MAX_CHANGES 100000
+#define BENCH_MAX_TITLE 65536
+#define BENCH_LINELEN 256
+#define BENCH_STALL 5000	/* ms without an element */
+
+static const char *builtin[] = {
+	"changes 2000",
+	"run rapid",
+	"interval 2",
+	"run paced",
+	"interval 0",
+	"changes 300",
+	"title 8000",
+	"run huge-tags",
+	"title 40",
+	"split 3",
+	"run split",
+	"split 0",
+	"changes 100",
+	"delay 20",
+	"run slow",
+	"delay 0",
+	"changes 200",
+	"disconnect 10",
+	"run disconnects",
+	"disconnect 0",
+	"stream 1",
+	"run stream",
+	NULL
+};
+
+struct scenario {
+	int		changes;
+	int		interval;	/* ms */
+	int		title;
+	int		split;
+	int		delay;		/* ms */
+	int		disconnect;
+	int		stream;
+};
+
+struct result {
+	int		frames;
+	int		reconnects;
+	int		lost;
+	int		wrong;
+	long long	elapsed;	/* ns */
+};
+
+/* mpd.c needs these from lemonbar-status */
+struct status status;
+static struct config bench_config = { .mpd_host = "127.0.0.1" };
+const struct config *_Atomic config = &bench_config;
+
+static struct scenario scenario = { 1000, 0, 40, 0, 0, 0, 0 };
+static _Atomic long long injected[BENCH_MAX_CHANGES + 1];	/* ns */
+static char title[BENCH_MAX_TITLE + 1];
+static int listen_fd;
+
+static int	run(const char *);
+static void    *server(void *);
+static int	server_serve(int, int *);
+static void	server_send(int, const char *);
+static int	client_connect(char **);
+static int	client_song(const char *);
+static long long now();
+static int	compare(const void *, const void *);
+static void	usage();
+
+int
+main(int argc, char *argv[])
+{
+	struct sockaddr_in sin;
+	socklen_t len;
+	FILE *fp;
+	char line[BENCH_LINELEN], port[8], *p, *key, *value;
+	const char *errstr;
+	int ch, i, lineno, failed, *setting;
+
+	fp = NULL;
+
+	while ((ch = getopt(argc, argv, "f:")) != -1) {
+		switch (ch) {
+		case 'f':
+			if ((fp = fopen(optarg, "r")) == NULL)
+				err(1, "cannot open %s", optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	/* both sides see the connections being dropped */
+	signal(SIGPIPE, SIG_IGN);
+
+	if ((listen_fd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+		err(1, "socket");
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	len = sizeof(sin);
+	if (bind(listen_fd, (struct sockaddr *)&sin, sizeof(sin)) == -1 ||
+	    listen(listen_fd, 1) == -1 ||
+	    getsockname(listen_fd, (struct sockaddr *)&sin, &len) == -1)
+		err(1, "cannot listen");
+
+	/* the environment takes precedence over the configuration */
+	snprintf(port, sizeof(port), "%d", ntohs(sin.sin_port));
+	setenv("MPD_HOST", "127.0.0.1", 1);
+	setenv("MPD_PORT", port, 1);
+
+	printf("%-12s %7s %7s %5s %9s %9s %9s %9s\n", "scenario", "changes",
+	    "frames", "recon", "p50 us", "p99 us", "max us", "changes/s");
+
+	failed = 0;
+	for (lineno = 1, i = 0; ; lineno++) {
+		if (fp != NULL) {
+			if (fgets(line, sizeof(line), fp) == NULL)
+				break;
+		} else {
+			if (builtin[i] == NULL)
+				break;
+			strlcpy(line, builtin[i++], sizeof(line));
+		}
+
+		if ((p = strchr(line, '#')) != NULL)
+			*p = '\0';
+		p = line;
+		while ((key = strsep(&p, " \t\n")) != NULL && *key == '\0')
+			;
+		if (key == NULL)
+			continue;
+		while ((value = strsep(&p, " \t\n")) != NULL && *value == '\0')
+			;
+		if (value == NULL)
+			errx(1, "line %d: %s needs a value", lineno, key);
+
+		if (strcmp(key, "run") == 0) {
+			failed |= !run(value);
+			continue;
+		}
+
+		if (strcmp(key, "changes") == 0)
+			setting = &scenario.changes;
+		else if (strcmp(key, "interval") == 0)
+			setting = &scenario.interval;
+		else if (strcmp(key, "title") == 0)
+			setting = &scenario.title;
+		else if (strcmp(key, "split") == 0)
+			setting = &scenario.split;
+		else if (strcmp(key, "delay") == 0)
+			setting = &scenario.delay;
+		else if (strcmp(key, "disconnect") == 0)
+			setting = &scenario.disconnect;
+		else if (strcmp(key, "stream") == 0)
+			setting = &scenario.stream;
+		else
+			errx(1, "line %d: unknown command %s", lineno, key);
+
+		*setting = strtonum(value, 0, strcmp(key, "changes") == 0 ?
+		    BENCH_MAX_CHANGES : strcmp(key, "title") == 0 ?
+		    BENCH_MAX_TITLE : INT_MAX, &errstr);
+		if (errstr != NULL)
+			errx(1, "line %d: %s %s: %s", lineno, key, value,
+			    errstr);
+	}
+
+	return failed;
+}
+
+/*
+ * Follows the changes of the scenario like the event loop of
+ * lemonbar-status and prints the statistics. Returns 0 if the client
+ * has failed.
+ */
+static int
+run(const char *name)
+{
+	const struct scenario *sc = &scenario;
+	static long long latencies[BENCH_MAX_CHANGES];
+	struct result r;
+	struct pollfd pfd;
+	pthread_t thread;
+	char *info;
+	long long start;
+	int fd, song, seen, n;
+
+	memset(&r, 0, sizeof(r));
+	memset(title, 'x', sc->title);
+	title[sc->title] = '\0';
+
+	if (pthread_create(&thread, NULL, server, NULL) != 0)
+		errx(1, "cannot start the server");
+
+	start = now();
+	seen = n = 0;
+	if ((fd = client_connect(&info)) == -1)
+		errx(1, "%s: cannot connect", name);
+
+	while (seen < sc->changes) {
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, BENCH_STALL) <= 0) {
+			warnx("%s: stalled after %d changes", name, seen);
+			break;
+		}
+
+		if (mpd_idle_end(fd) == -1 || (info = mpd_info(fd)) == NULL) {
+			close(fd);
+			r.reconnects++;
+			if ((fd = client_connect(&info)) == -1) {
+				warnx("%s: cannot reconnect", name);
+				break;
+			}
+		} else
+			mpd_idle_start(fd);
+		r.frames++;
+
+		if ((song = client_song(info)) < 0) {
+			r.wrong++;
+			continue;
+		}
+		if (song > seen) {
+			r.lost += song - seen - 1;
+			latencies[n++] = now() - atomic_load(&injected[song]);
+			seen = song;
+		}
+	}
+	r.elapsed = now() - start;
+	close(fd);
+	pthread_join(thread, NULL);
+
+	r.lost += sc->changes - seen;
+	qsort(latencies, n, sizeof(latencies[0]), compare);
+	printf("%-12s %7d %7d %5d %9lld %9lld %9lld %9.0f\n", name, seen,
+	    r.frames, r.reconnects,
+	    n > 0 ? latencies[n / 2] / 1000 : 0,
+	    n > 0 ? latencies[n * 99 / 100] / 1000 : 0,
+	    n > 0 ? latencies[n - 1] / 1000 : 0,
+	    seen * 1e9 / r.elapsed);
+
+	if (r.lost > 0 || r.wrong > 0) {
+		warnx("%s: %d changes lost, %d wrong elements", name, r.lost,
+		    r.wrong);
+		return 0;
+	}
+
+	return 1;
+}
+
+/* Connects like lemonbar-status and leaves the connection idle. */
+static int
+client_connect(char **info)
+{
+	int fd;
+
+	if ((fd = mpd_init()) == -1)
+		return -1;
+	if ((*info = mpd_info(fd)) == NULL) {
+		close(fd);
+		return -1;
+	}
+	mpd_idle_start(fd);
+
+	return fd;
+}
+
+/* Returns the song number in the element or -1 if it is malformed. */
+static int
+client_song(const char *info)
+{
+	const char *p;
+
+	if (strlen(info) >= MPD_INFOLEN ||
+	    (p = strstr(info, "bench: song-")) == NULL)
+		return -1;
+
+	return atoi(p + sizeof("bench: song-") - 1);
+}
+
+/*
+ * Serves the connections of one scenario until the client hangs up,
+ * which it does once it has seen all changes.
+ */
+static void *
+server(void *arg)
+{
+	int fd, dropped, one = 1, song = 0;
+
+	(void)arg;
+
+	do {
+		if ((fd = accept(listen_fd, NULL, NULL)) == -1)
+			err(1, "accept");
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		dropped = server_serve(fd, &song);
+		close(fd);
+	} while (dropped);
+
+	return NULL;
+}
+
+/*
+ * Speaks the protocol on one connection. Returns 0 when the client has
+ * hung up, 1 if the connection was dropped on purpose.
+ */
+static int
+server_serve(int fd, int *song)
+{
+	static char buf[BENCH_MAX_TITLE + 256];
+	char rbuf[BENCH_LINELEN], *nl;
+	struct pollfd pfd;
+	long long due;
+	size_t rlen;
+	ssize_t n;
+	int idle, timeout;
+
+	rlen = 0;
+	idle = 0;
+	due = 0;
+	server_send(fd, "OK MPD 0.23.5\n");
+
+	for (;;) {
+		timeout = -1;
+		if (idle && *song < scenario.changes)
+			timeout = due > now() ? (due - now()) / 1000000 : 0;
+
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, timeout) == 0) {
+			/* announce the next song to the idle client */
+			(*song)++;
+			atomic_store(&injected[*song], now());
+			due = now() + scenario.interval * 1000000LL;
+			idle = 0;
+			if (scenario.disconnect > 0 &&
+			    *song % scenario.disconnect == 0)
+				return 1;
+			server_send(fd, scenario.stream ?
+			    "changed: player\nOK\n" :
+			    "changed: player\nchanged: playlist\nOK\n");
+			continue;
+		}
+
+		if ((n = recv(fd, rbuf + rlen, sizeof(rbuf) - rlen, 0)) <= 0)
+			return 0;
+		rlen += n;
+
+		while ((nl = memchr(rbuf, '\n', rlen)) != NULL) {
+			*nl = '\0';
+			if (strncmp(rbuf, "idle", 4) == 0)
+				idle = 1;
+			else if (strcmp(rbuf, "noidle") == 0) {
+				if (idle)
+					server_send(fd, "OK\n");
+				idle = 0;
+			} else if (strcmp(rbuf, "status") == 0) {
+				snprintf(buf, sizeof(buf), "volume: 50\n"
+				    "repeat: 0\nrandom: 1\nsingle: 0\n"
+				    "consume: 0\nstate: play\nsong: %d\n"
+				    "songid: %d\nOK\n", *song,
+				    scenario.stream ? 1 : *song + 1);
+				server_send(fd, buf);
+			} else if (strcmp(rbuf, "currentsong") == 0) {
+				snprintf(buf, sizeof(buf), "file: song-%d\n"
+				    "Name: bench\nTitle: song-%d %s\nId: %d\n"
+				    "OK\n", *song, *song, title,
+				    scenario.stream ? 1 : *song + 1);
+				server_send(fd, buf);
+			} else if (strcmp(rbuf, "outputs") == 0)
+				server_send(fd, "outputid: 0\n"
+				    "outputname: bench\noutputenabled: 1\nOK\n");
+			else
+				server_send(fd, "OK\n");
+			rlen -= nl + 1 - rbuf;
+			memmove(rbuf, nl + 1, rlen);
+		}
+		if (rlen == sizeof(rbuf))
+			errx(1, "command too long");
+	}
+}
+
+/* Sends str after the delay, in pieces if the scenario splits. */
+static void
+server_send(int fd, const char *str)
+{
+	size_t len, n;
+
+	if (scenario.delay > 0)
+		usleep(scenario.delay * 1000);
+
+	for (len = strlen(str); len > 0; len -= n, str += n) {
+		n = scenario.split > 0 && (size_t)scenario.split < len ?
+		    (size_t)scenario.split : len;
+		if (send(fd, str, n, 0) == -1)
+			return;
+		/* let every piece leave as a segment of its own */
+		if (scenario.split > 0)
+			usleep(50);
+	}
+}
+
+static long long
+now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int
+compare(const void *a, const void *b)
+{
+	long long x = *(const long long *)a, y = *(const long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void
+usage()
+{
+	fprintf(stderr, "usage: mpd-bench [-f script]\n");
+	exit(1);
+}
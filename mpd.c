@@ -7,39 +7,96 @@
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 
 #include <arpa/inet.h>
 
+#include "config.h"
+#include "health.h"
+#include "marquee.h"
 #include "mpd.h"
+#include "status.h"
 
-#define PORT "6600"
-
-#define MAXDATASIZE 1024 /* TODO: What is sensible for mpd? */
+#define MAXDATASIZE 1024 /* longer lines are truncated */
+#define TIMEOUT 2 /* seconds to wait for a response */
 
 #define OKSTR "OK MPD "
-#define IDLESTR "idle player\n"
+#define IDLESTR "idle player mixer options playlist output\n"
 #define CURRENTSTR "currentsong\n"
-#define TITLESTR "\nTitle: "
-#define NAMESTR "\nName: "
+#define TITLESTR "Title: "
+#define NAMESTR "Name: "
 #define STATUSSTR "status\n"
-#define STATESTR "\nstate: "
-
-char *
-find_tag(char *str, char* tag, size_t offset)
-{
-        char *pos;
-
-        pos = strstr(str, tag);
-
-        return pos ? pos + offset : NULL;
-}
-
-void
-terminate_str(char *str)
-{
-        char *pos = strchr(str, '\n');
-        *pos = '\0';
-}
+#define STATESTR "state: "
+#define SONGIDSTR "songid: "
+#define VOLUMESTR "volume: "
+#define REPEATSTR "repeat: "
+#define RANDOMSTR "random: "
+#define SINGLESTR "single: "
+#define CONSUMESTR "consume: "
+#define OUTPUTSSTR "outputs\n"
+#define ENABLEDSTR "outputenabled: 1"
+#define CHANGEDSTR "changed: "
+#define NOIDLESTR "noidle\n"
+#define OKRESPSTR "OK"
+#define ACKRESPSTR "ACK "
+
+/* Subsystems reported by idle */
+#define CHANGED_PLAYER          0x01
+#define CHANGED_MIXER           0x02
+#define CHANGED_OPTIONS         0x04
+#define CHANGED_PLAYLIST        0x08
+#define CHANGED_OUTPUT          0x10
+#define CHANGED_ALL             0x1f
+
+/* Subsystems whose fields are part of the status response */
+#define CHANGED_STATUS (CHANGED_PLAYER | CHANGED_MIXER | CHANGED_OPTIONS | \
+    CHANGED_PLAYLIST)
+
+struct mpd_field {
+        const char     *key;
+        char           *value;
+        size_t          len;
+        int             count;  /* number of matching lines */
+};
+
+static const struct {
+        const char     *name;
+        int             flag;
+} subsystems[] = {
+        { "player", CHANGED_PLAYER },
+        { "mixer", CHANGED_MIXER },
+        { "options", CHANGED_OPTIONS },
+        { "playlist", CHANGED_PLAYLIST },
+        { "output", CHANGED_OUTPUT },
+        { NULL, 0 }
+};
+
+/*
+ * The last fetched values. Only the responses belonging to the
+ * subsystems in changed are requested again.
+ */
+static struct {
+        int             changed;
+        char            state[16];
+        char            songid[16];
+        char            volume[8];
+        char            repeat[4];
+        char            random[4];
+        char            single[8];
+        char            consume[8];
+        char            name[STATUS_STRLEN];
+        char            title[STATUS_STRLEN];
+        int             outputs;        /* enabled outputs, -1 if unknown */
+} cache;
+
+static char rbuf[MAXDATASIZE];
+static size_t rlen;
+
+static char    *mpd_read_line(int);
+static int      mpd_read_response(int, struct mpd_field *);
+static int      mpd_send(int, const char *);
+static int      mpd_fetch(int);
+static void     mpd_format(char *, size_t);
 
 void *
 get_in_addr(struct sockaddr *sa)
@@ -54,31 +111,38 @@ get_in_addr(struct sockaddr *sa)
 int
 mpd_init()
 {
-        int sockfd, numbytes;
-        char buf[64];
+        int sockfd;
+        char *line, *host, *port;
         struct addrinfo hints, *servinfo, *p;
+        struct timeval tv;
         int rv;
         char s[INET6_ADDRSTRLEN];
 
+        if ((host = getenv("MPD_HOST")) == NULL)
+                host = (char *)config->mpd_host;
+        if ((port = getenv("MPD_PORT")) == NULL)
+                port = (char *)config->mpd_port;
+
         memset(&hints, 0, sizeof hints);
         hints.ai_family = AF_UNSPEC;
         hints.ai_socktype = SOCK_STREAM;
 
-        if ((rv = getaddrinfo("localhost", PORT, &hints, &servinfo)) != 0) {
-                fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(rv));
+        /* the connection is retried, so warnings are rate-limited */
+        if ((rv = getaddrinfo(host, port, &hints, &servinfo)) != 0) {
+                health_warnx(HEALTH_MPD, "getaddrinfo: %s",
+                    gai_strerror(rv));
                 return -1;
         }
 
         for (p = servinfo; p != NULL; p = p->ai_next) {
                 if ((sockfd = socket(p->ai_family, p->ai_socktype,
-                    p->ai_protocol)) == -1) {
-                        perror("client: socket");
+                    p->ai_protocol)) == -1)
                         continue;
-                }
 
                 if (connect(sockfd, p->ai_addr, p->ai_addrlen) == -1) {
+                        rv = errno;
                         close(sockfd);
-                        perror("client: connect");
+                        errno = rv;
                         continue;
                 }
 
@@ -86,7 +150,9 @@ mpd_init()
         }
 
         if (p == NULL) {
-                fprintf(stderr, "client: failed to connect\n");
+                health_warn(HEALTH_MPD, "cannot connect to mpd at %s:%s",
+                    host, port);
+                freeaddrinfo(servinfo);
                 return -1;
         }
 
@@ -95,87 +161,324 @@ mpd_init()
 
         freeaddrinfo(servinfo);
 
-        if ((numbytes = recv(sockfd, buf, MAXDATASIZE - 1, 0)) == -1) {
-                perror("recv");
-                return -1;
-        }
+        /* a stalled server must not block the whole bar */
+        tv.tv_sec = TIMEOUT;
+        tv.tv_usec = 0;
+        if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv)
+            == -1)
+                perror("setsockopt");
 
-        buf[numbytes] = '\0';
+        rlen = 0;
+        cache.changed = CHANGED_ALL;
+        cache.outputs = -1;
 
-        if (numbytes <= sizeof OKSTR  - 1 ||
-            strncmp(buf, OKSTR, sizeof OKSTR - 1) != 0) {
+        if ((line = mpd_read_line(sockfd)) == NULL ||
+            strncmp(line, OKSTR, sizeof OKSTR - 1) != 0) {
                 fprintf(stderr, "Not an MPD server\n");
+                close(sockfd);
                 return -1;
         }
 
         return sockfd;
 }
 
+/*
+ * Adopts a connection which was handed over by a re-exec. It is still
+ * idle; everything is fetched again at the next change.
+ */
+void
+mpd_resume()
+{
+        rlen = 0;
+        cache.changed = CHANGED_ALL;
+        cache.outputs = -1;
+}
+
+/*
+ * Closes a failed connection and forgets the state, so that nothing
+ * keeps acting on a song which is no longer shown.
+ */
+void
+mpd_close(int sockfd)
+{
+        close(sockfd);
+        status.mpd.state = MPD_STATE_UNKNOWN;
+        status.mpd.valid = 0;
+}
+
 void
 mpd_idle_start(int sockfd)
 {
         send(sockfd, IDLESTR, (sizeof IDLESTR) - 1, 0);
 }
 
-void
+/*
+ * Reads the response to idle, which lists the changed subsystems.
+ * Returns -1 if the connection has failed.
+ */
+int
 mpd_idle_end(int sockfd)
 {
-        int numbytes;
-        char *buf[MAXDATASIZE];
+        return mpd_read_response(sockfd, NULL) == -1 ? -1 : 0;
+}
 
-        if ((numbytes = recv(sockfd, buf + 1, MAXDATASIZE - 2, 0))
-            == -1) {
-                perror("recv");
-                exit(1);
+/*
+ * Returns the next line without the newline. Lines may arrive split
+ * over several segments or several in one segment. Lines longer than
+ * MAXDATASIZE - 1 are truncated. Returns NULL if the connection has
+ * failed or timed out.
+ */
+static char *
+mpd_read_line(int sockfd)
+{
+        static char line[MAXDATASIZE];
+        size_t linelen, len, n;
+        ssize_t numbytes;
+        char *nl;
+
+        linelen = 0;
+
+        for (;;) {
+                nl = memchr(rbuf, '\n', rlen);
+                len = nl ? (size_t)(nl - rbuf) : rlen;
+
+                n = len < sizeof line - 1 - linelen ?
+                    len : sizeof line - 1 - linelen;
+                memcpy(line + linelen, rbuf, n);
+                linelen += n;
+
+                if (nl) {
+                        rlen -= len + 1;
+                        memmove(rbuf, nl + 1, rlen);
+                        line[linelen] = '\0';
+                        return line;
+                }
+                rlen = 0;
+
+                if ((numbytes = recv(sockfd, rbuf, sizeof rbuf, 0)) <= 0) {
+                        if (numbytes == 0)
+                                fprintf(stderr, "mpd closed the connection\n");
+                        else
+                                perror("recv");
+                        return NULL;
+                }
+                rlen = numbytes;
         }
 }
 
-char *
-mpd_info(int sockfd)
+/*
+ * Reads a complete response, which ends with "OK" or an "ACK" error
+ * line. The values of the lines starting with the keys of fields are
+ * copied into the fields. Changed subsystems, as reported by idle and
+ * noidle, are added to the cache. Returns 1 on success, 0 on an error
+ * response and -1 if the connection failed.
+ */
+static int
+mpd_read_response(int sockfd, struct mpd_field *fields)
 {
-        int numbytes, nprinted;
-        char *name, *title, *status;
-        char buf[MAXDATASIZE];
-        static char info[MPD_INFOLEN];
+        struct mpd_field *f;
+        char *line;
+        int i;
 
-        buf[0] = '\n';
-        nprinted = 0;
+        for (f = fields; f && f->key; f++) {
+                f->value[0] = '\0';
+                f->count = 0;
+        }
+
+        while ((line = mpd_read_line(sockfd)) != NULL) {
+                if (strcmp(line, OKRESPSTR) == 0)
+                        return 1;
+                if (strncmp(line, ACKRESPSTR, sizeof ACKRESPSTR - 1) == 0) {
+                        fprintf(stderr, "mpd: %s\n", line);
+                        return 0;
+                }
+                if (strncmp(line, CHANGEDSTR, sizeof CHANGEDSTR - 1) == 0) {
+                        for (i = 0; subsystems[i].name; i++)
+                                if (strcmp(line + sizeof CHANGEDSTR - 1,
+                                    subsystems[i].name) == 0)
+                                        cache.changed |= subsystems[i].flag;
+                        continue;
+                }
+                for (f = fields; f && f->key; f++)
+                        if (strncmp(line, f->key, strlen(f->key)) == 0) {
+                                if (strlcpy(f->value, line + strlen(f->key),
+                                    f->len) >= f->len)
+                                        marquee_trim(f->value);
+                                f->count++;
+                                break;
+                        }
+        }
 
-        send(sockfd, STATUSSTR, (sizeof STATUSSTR) - 1, 0);
-        if ((numbytes = recv(sockfd, buf + 1, MAXDATASIZE - 2, 0))
-            == -1) {
-                perror("recv");
-                exit(1);
+        return -1;
+}
+
+static int
+mpd_send(int sockfd, const char *cmd)
+{
+        size_t len = strlen(cmd);
+
+        if (send(sockfd, cmd, len, 0) != (ssize_t)len) {
+                perror("send");
+                return -1;
         }
 
-        buf[numbytes + 1] = '\0';
-        status = find_tag(buf, STATESTR, sizeof STATESTR - 1);
-        if (status) {
-                terminate_str(status);
-                if (strcmp(status, "stop") == 0)
-                        nprinted = snprintf(info, MPD_INFOLEN,
-                                        "STOPPED - ");
-                else if (strcmp(status, "pause") == 0)
-                        nprinted = snprintf(info, MPD_INFOLEN, "PAUSED - ");
+        return 0;
+}
+
+/*
+ * Leaves idle mode and sends a playback command. The caller has to call
+ * mpd_info() and mpd_idle_start() afterwards. Returns -1 if the
+ * connection has failed.
+ */
+int
+mpd_command(int sockfd, const char *cmd)
+{
+        int res;
+
+        if (mpd_send(sockfd, NOIDLESTR) == -1 ||
+            mpd_read_response(sockfd, NULL) == -1 ||
+            mpd_send(sockfd, cmd) == -1 ||
+            (res = mpd_read_response(sockfd, NULL)) == -1)
+                return -1;
+
+        /* the change is only reported by the next idle */
+        if (res)
+                cache.changed |= CHANGED_PLAYER;
+
+        return res;
+}
+
+/*
+ * Requests the responses belonging to the changed subsystems. The song
+ * is fetched again on every player change, which is how a stream
+ * announces new tags under the same id, and if the playlist or the
+ * song id has changed. Returns -1 if the connection has failed.
+ */
+static int
+mpd_fetch(int sockfd)
+{
+        char state[16], songid[16], enabled[1];
+        struct mpd_field status_fields[] = {
+                { STATESTR, state, sizeof state },
+                { SONGIDSTR, songid, sizeof songid },
+                { VOLUMESTR, cache.volume, sizeof cache.volume },
+                { REPEATSTR, cache.repeat, sizeof cache.repeat },
+                { RANDOMSTR, cache.random, sizeof cache.random },
+                { SINGLESTR, cache.single, sizeof cache.single },
+                { CONSUMESTR, cache.consume, sizeof cache.consume },
+                { NULL, NULL, 0 }
+        };
+        struct mpd_field song_fields[] = {
+                { NAMESTR, cache.name, sizeof cache.name },
+                { TITLESTR, cache.title, sizeof cache.title },
+                { NULL, NULL, 0 }
+        };
+        struct mpd_field output_fields[] = {
+                { ENABLEDSTR, enabled, sizeof enabled },
+                { NULL, NULL, 0 }
+        };
+        int changed, res;
+
+        changed = cache.changed;
+        cache.changed = 0;
+
+        if (changed & CHANGED_STATUS) {
+                if (mpd_send(sockfd, STATUSSTR) == -1 ||
+                    mpd_read_response(sockfd, status_fields) == -1)
+                        return -1;
+                strlcpy(cache.state, state, sizeof cache.state);
+                if (strcmp(songid, cache.songid) != 0) {
+                        strlcpy(cache.songid, songid, sizeof cache.songid);
+                        changed |= CHANGED_PLAYLIST;
+                }
         }
 
-        send(sockfd, CURRENTSTR, (sizeof CURRENTSTR) - 1, 0);
-        if ((numbytes = recv(sockfd, buf + 1, MAXDATASIZE - 2, 0))
-            == -1) {
-                perror("recv");
-                exit(1);
+        if (changed & (CHANGED_PLAYER | CHANGED_PLAYLIST)) {
+                if (mpd_send(sockfd, CURRENTSTR) == -1 ||
+                    mpd_read_response(sockfd, song_fields) == -1)
+                        return -1;
         }
 
-        buf[numbytes + 1] = '\0';
+        if (changed & CHANGED_OUTPUT) {
+                if (mpd_send(sockfd, OUTPUTSSTR) == -1 ||
+                    (res = mpd_read_response(sockfd, output_fields)) == -1)
+                        return -1;
+                cache.outputs = res ? output_fields[0].count : -1;
+        }
 
-        name = find_tag(buf, NAMESTR, sizeof NAMESTR - 1);
-        if (name) terminate_str(name);
+        return 0;
+}
 
-        title = find_tag(buf, TITLESTR, sizeof TITLESTR - 1);
-        if (title) terminate_str(title);
+/* Formats the cached values and updates the status. */
+static void
+mpd_format(char *info, size_t len)
+{
+        char flags[5];
+        int nprinted, n;
+
+        nprinted = 0;
+        status.mpd.state = MPD_STATE_UNKNOWN;
+
+        if (strcmp(cache.state, "stop") == 0) {
+                status.mpd.state = MPD_STATE_STOP;
+                nprinted = snprintf(info, len, "STOPPED - ");
+        } else if (strcmp(cache.state, "pause") == 0) {
+                status.mpd.state = MPD_STATE_PAUSE;
+                nprinted = snprintf(info, len, "PAUSED - ");
+        } else if (strcmp(cache.state, "play") == 0)
+                status.mpd.state = MPD_STATE_PLAY;
+
+        if (cache.outputs == 0)
+                nprinted += snprintf(info + nprinted, len - nprinted,
+                    "NO OUTPUT - ");
+
+        nprinted += snprintf(info + nprinted, len - nprinted, "%s: %s",
+            cache.name[0] ? cache.name : "UNKNOWN NAME",
+            cache.title[0] ? cache.title : "UNKNOWN TITLE");
+
+        /* the same letters as ncmpcpp, only those of enabled options */
+        n = 0;
+        if ((status.mpd.repeat = strcmp(cache.repeat, "1") == 0))
+                flags[n++] = 'r';
+        if ((status.mpd.random = strcmp(cache.random, "1") == 0))
+                flags[n++] = 'z';
+        if ((status.mpd.single = strcmp(cache.single, "0") != 0 &&
+            cache.single[0] != '\0'))
+                flags[n++] = 's';
+        if ((status.mpd.consume = strcmp(cache.consume, "0") != 0 &&
+            cache.consume[0] != '\0'))
+                flags[n++] = 'c';
+        flags[n] = '\0';
+
+        if (n > 0 && (size_t)nprinted < len)
+                snprintf(info + nprinted, len - nprinted, " [%s]", flags);
+
+        strlcpy(status.mpd.name, cache.name, sizeof(status.mpd.name));
+        strlcpy(status.mpd.title, cache.title, sizeof(status.mpd.title));
+        status.mpd.volume = cache.volume[0] ? atoi(cache.volume) : -1;
+        status.mpd.outputs = cache.outputs;
+        status.mpd.valid = 1;
+}
+
+/*
+ * Returns the element for the current state, which is only formatted
+ * again if a subsystem has changed. Returns NULL if the connection has
+ * failed.
+ */
+char *
+mpd_info(int sockfd)
+{
+        static char info[MPD_INFOLEN];
+
+        if (cache.changed == 0 && status.mpd.valid)
+                return info;
+
+        if (mpd_fetch(sockfd) == -1) {
+                status.mpd.valid = 0;
+                return NULL;
+        }
 
-        snprintf(info + nprinted, MPD_INFOLEN - nprinted, "%s: %s",
-            name ? name : "UNKNOWN NAME", title ? title : "UNKNOWN TITLE");
+        mpd_format(info, sizeof info);
 
         return info;
 }
@@ -1,6 +1,9 @@
-#define MPD_INFOLEN 128
+#define MPD_INFOLEN 320	/* the marquee limits the displayed width */
 
 int     mpd_init();
+void    mpd_resume();
+void    mpd_close(int);
 void    mpd_idle_start(int);
-void    mpd_idle_end(int);
+int     mpd_idle_end(int);
 char   *mpd_info(int);
+int     mpd_command(int, const char *);
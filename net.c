@@ -12,7 +12,10 @@
 #include <string.h>
 #include <unistd.h>
 
-#define IFNAME "trunk0"
+#include "config.h"
+#include "health.h"
+#include "net.h"
+#include "status.h"
 
 char *
 net_info()
@@ -28,25 +31,27 @@ net_info()
 	int i, s, len;
 
 	rp = NULL;
+	status.net.valid = 0;
 
 	if ((s = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
-	    warn("coud not open socket");
+	    health_warn(HEALTH_NET, "coud not open socket");
+	    health_fail(HEALTH_NET);
 	    return res;
 	}
 
 	/* Trunk ports */
 
-	strlcpy(ra.ra_ifname, IFNAME, sizeof(ra.ra_ifname));
+	strlcpy(ra.ra_ifname, config->interface, sizeof(ra.ra_ifname));
 	ra.ra_size = sizeof(rpbuf);
 	ra.ra_port = rpbuf;
 
 	if (ioctl(s, SIOCGTRUNK, &ra)) {
-		warn("could not query trunk properties");
+		health_warn(HEALTH_NET, "could not query trunk properties");
 		goto cleanup;
 	}
 
 	if (!(ra.ra_proto & TRUNK_PROTO_FAILOVER)) {
-		warnx("trunk protocol is not 'failover'");
+		health_warnx(HEALTH_NET, "trunk protocol is not 'failover'");
 		goto cleanup;
 	}
 
@@ -57,16 +62,16 @@ net_info()
 		}
 
 	if (rp == NULL) {
-		warnx("no active trunk port found");
+		health_warnx(HEALTH_NET, "no active trunk port found");
 		goto cleanup;
 	}
 
 
 	/* IP address */
 
-	strlcpy(ifr.ifr_name, IFNAME, sizeof(ifr.ifr_name));
+	strlcpy(ifr.ifr_name, config->interface, sizeof(ifr.ifr_name));
 	if (ioctl(s, SIOCGIFADDR, &ifr) == -1) {
-		warn("could not query inet address");
+		health_warn(HEALTH_NET, "could not query inet address");
 		goto cleanup;
 	}
 
@@ -78,7 +83,7 @@ net_info()
 		addrp = &((struct sockaddr_in6 *)&ifr.ifr_addr)->sin6_addr;
 		break;
 	default:
-		warnx("unknown inet address protocol");
+		health_warnx(HEALTH_NET, "unknown inet address protocol");
 		goto cleanup;
 	}
 
@@ -92,13 +97,23 @@ net_info()
 
 	if (inet_ntop(ifr.ifr_addr.sa_family, addrp,
 	    str + len + 1, sizeof(str) - len - 1) == NULL) {
-		warn("could not convert inet address");
+		health_warn(HEALTH_NET, "could not convert inet address");
 		goto cleanup;
 	}
 
+	strlcpy(status.net.interface, rp->rp_portname,
+	    sizeof(status.net.interface));
+	strlcpy(status.net.address, str + len + 1,
+	    sizeof(status.net.address));
+	status.net.valid = 1;
+
 	res = str;
 
 cleanup:
 	close(s);
+	if (res != NULL)
+		health_ok(HEALTH_NET);
+	else
+		health_fail(HEALTH_NET);
 	return res;
 }
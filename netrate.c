@@ -0,0 +1,297 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/sysctl.h>
+#include <net/if.h>
+#include <net/if_dl.h>
+#include <net/route.h>
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "filter.h"
+#include "netrate.h"
+#include "status.h"
+
+#define NETRATE_BUFLEN 64
+#define NETRATE_MAX_IFS 8
+#define NETRATE_ROUTE_BUFLEN 2048
+
+/* Eight levels, each glyph is a three byte UTF-8 sequence */
+static const char *spark_glyphs[] = { "▁", "▂", "▃", "▄", "▅", "▆",
+    "▇", "█" };
+
+#define SPARK_LEVELS ((int)(sizeof(spark_glyphs) / sizeof(spark_glyphs[0])))
+
+struct netrate_if {
+	char		name[IFNAMSIZ];
+	unsigned int	index;
+	int		link_up;
+	uint64_t	ibytes;
+	uint64_t	obytes;
+	long long	time;		/* ms of the last sample */
+	int		head;		/* next slot in the rings */
+	int		count;
+	long long	rx[NETRATE_HISTORY];	/* bytes/s */
+	long long	tx[NETRATE_HISTORY];	/* bytes/s */
+};
+
+static struct netrate_if ifs[NETRATE_MAX_IFS];
+static char *iflist = NULL;
+static size_t iflist_len = 0;
+static int route_fd = -1, initialized = 0;
+
+static struct netrate_if *netrate_find(const char *);
+static struct netrate_if *netrate_active();
+static int	netrate_sample();
+static int	netrate_format_rate(char *, size_t, long long);
+
+/*
+ * Opens a routing socket which reports interface state changes. The
+ * returned descriptor has to be watched for reading.
+ */
+int
+netrate_init()
+{
+	unsigned int filter;
+
+	if (initialized)
+		errx(1, "netrate_init called twice");
+
+	initialized = 1;
+
+	if ((route_fd = socket(AF_ROUTE, SOCK_RAW, AF_UNSPEC)) == -1) {
+		warn("cannot open routing socket");
+		return -1;
+	}
+
+	filter = ROUTE_FILTER(RTM_IFINFO);
+	if (setsockopt(route_fd, AF_ROUTE, ROUTE_MSGFILTER, &filter,
+	    sizeof(filter)) == -1)
+		warn("cannot filter routing messages");
+
+	netrate_sample();
+
+	return route_fd;
+}
+
+/*
+ * Processes routing messages. Returns 1 if the link state of the
+ * interface displayed in the network element has changed.
+ */
+int
+netrate_route(int fd)
+{
+	char buf[NETRATE_ROUTE_BUFLEN];
+	struct if_msghdr *ifm;
+	struct netrate_if *active;
+	ssize_t n;
+	int up, changed = 0;
+
+	if ((n = read(fd, buf, sizeof(buf))) <= 0) {
+		if (n == -1 && errno != EAGAIN)
+			warn("cannot read routing socket");
+		return 0;
+	}
+
+	ifm = (struct if_msghdr *)buf;
+	if (n < (ssize_t)sizeof(*ifm) || ifm->ifm_type != RTM_IFINFO)
+		return 0;
+
+	active = netrate_active();
+	if (active == NULL || active->index != ifm->ifm_index)
+		return 0;
+
+	up = LINK_STATE_IS_UP(ifm->ifm_data.ifi_link_state);
+	if (up != active->link_up) {
+		active->link_up = up;
+		active->count = 0;	/* do not bridge the down time */
+		active->time = 0;
+		changed = 1;
+	}
+
+	return changed;
+}
+
+/* Is the link of the interface displayed in the network element up? */
+int
+netrate_up()
+{
+	struct netrate_if *active;
+
+	if ((active = netrate_active()) == NULL)
+		return 0;
+
+	return active->link_up;
+}
+
+char *
+netrate_info()
+{
+	static char str[NETRATE_BUFLEN + NETRATE_HISTORY * 3];
+	struct netrate_if *active;
+	long long max, v;
+	int i, j, n;
+
+	status.netrate.valid = 0;
+
+	if (!netrate_sample())
+		return NULL;
+
+	if ((active = netrate_active()) == NULL || !active->link_up ||
+	    active->count == 0)
+		return NULL;
+
+	i = (active->head + NETRATE_HISTORY - 1) % NETRATE_HISTORY;
+	status.netrate.valid = 1;
+	status.netrate.rx = active->rx[i];
+	status.netrate.tx = active->tx[i];
+
+	n = strlcpy(str, "↓", sizeof(str));
+	n += netrate_format_rate(str + n, sizeof(str) - n, active->rx[i]);
+	n += strlcpy(str + n, " ↑", sizeof(str) - n);
+	n += netrate_format_rate(str + n, sizeof(str) - n, active->tx[i]);
+	n += strlcpy(str + n, " ", sizeof(str) - n);
+
+	/* sparkline of the total rate, oldest sample first */
+	max = 1;
+	for (j = 0; j < active->count; j++) {
+		i = (active->head + NETRATE_HISTORY - active->count + j) %
+		    NETRATE_HISTORY;
+		if (active->rx[i] + active->tx[i] > max)
+			max = active->rx[i] + active->tx[i];
+	}
+	for (j = 0; j < active->count; j++) {
+		i = (active->head + NETRATE_HISTORY - active->count + j) %
+		    NETRATE_HISTORY;
+		v = (active->rx[i] + active->tx[i]) * (SPARK_LEVELS - 1) / max;
+		strlcat(str, spark_glyphs[v], sizeof(str));
+	}
+
+	return str;
+}
+
+/* The interface shown by net_info() */
+static struct netrate_if *
+netrate_active()
+{
+	if (!status.net.valid)
+		return NULL;
+
+	return netrate_find(status.net.interface);
+}
+
+static struct netrate_if *
+netrate_find(const char *name)
+{
+	int i;
+
+	for (i = 0; i < NETRATE_MAX_IFS && ifs[i].name[0] != '\0'; i++)
+		if (strcmp(ifs[i].name, name) == 0)
+			return &ifs[i];
+
+	return NULL;
+}
+
+/*
+ * Fetches the counters of all interfaces with a single sysctl(2) and
+ * appends the rates to the history rings.
+ */
+static int
+netrate_sample()
+{
+	int mib[6] = { CTL_NET, PF_ROUTE, 0, 0, NET_RT_IFLIST, 0 };
+	struct if_msghdr *ifm;
+	struct sockaddr_dl *sdl;
+	struct netrate_if *nif;
+	char name[IFNAMSIZ], *p, *newbuf;
+	long long now, dt;
+	size_t len;
+	int i;
+
+	for (;;) {
+		len = iflist_len;
+		if (iflist != NULL &&
+		    sysctl(mib, 6, iflist, &len, NULL, 0) == 0)
+			break;
+		if (iflist != NULL && errno != ENOMEM) {
+			warn("cannot get interface list");
+			return 0;
+		}
+		/* the buffer only grows if interfaces are added */
+		if (sysctl(mib, 6, NULL, &len, NULL, 0) == -1) {
+			warn("cannot get interface list size");
+			return 0;
+		}
+		len += len / 4;
+		if ((newbuf = realloc(iflist, len)) == NULL) {
+			warn("cannot allocate interface list");
+			return 0;
+		}
+		iflist = newbuf;
+		iflist_len = len;
+	}
+
+	now = filter_now();
+
+	for (p = iflist; p < iflist + len; p += ifm->ifm_msglen) {
+		ifm = (struct if_msghdr *)p;
+		if (ifm->ifm_msglen == 0)
+			break;
+		if (ifm->ifm_type != RTM_IFINFO ||
+		    !(ifm->ifm_addrs & RTA_IFP))
+			continue;
+
+		sdl = (struct sockaddr_dl *)(p + ifm->ifm_hdrlen);
+		if (sdl->sdl_family != AF_LINK || sdl->sdl_nlen == 0 ||
+		    sdl->sdl_nlen >= IFNAMSIZ)
+			continue;
+		memcpy(name, sdl->sdl_data, sdl->sdl_nlen);
+		name[sdl->sdl_nlen] = '\0';
+
+		if ((nif = netrate_find(name)) == NULL) {
+			for (i = 0; i < NETRATE_MAX_IFS &&
+			    ifs[i].name[0] != '\0'; i++)
+				;
+			if (i == NETRATE_MAX_IFS)
+				continue;
+			nif = &ifs[i];
+			strlcpy(nif->name, name, sizeof(nif->name));
+		}
+
+		nif->index = ifm->ifm_index;
+		nif->link_up = LINK_STATE_IS_UP(ifm->ifm_data.ifi_link_state);
+
+		dt = now - nif->time;
+		if (nif->time != 0 && dt > 0 &&
+		    ifm->ifm_data.ifi_ibytes >= nif->ibytes &&
+		    ifm->ifm_data.ifi_obytes >= nif->obytes) {
+			nif->rx[nif->head] = (ifm->ifm_data.ifi_ibytes -
+			    nif->ibytes) * 1000 / dt;
+			nif->tx[nif->head] = (ifm->ifm_data.ifi_obytes -
+			    nif->obytes) * 1000 / dt;
+			nif->head = (nif->head + 1) % NETRATE_HISTORY;
+			if (nif->count < NETRATE_HISTORY)
+				nif->count++;
+		}
+		nif->ibytes = ifm->ifm_data.ifi_ibytes;
+		nif->obytes = ifm->ifm_data.ifi_obytes;
+		nif->time = now;
+	}
+
+	return 1;
+}
+
+static int
+netrate_format_rate(char *str, size_t buflen, long long rate)
+{
+	if (rate < 1024)
+		return snprintf(str, buflen, "%lldB", rate);
+	else if (rate < 1024 * 1024)
+		return snprintf(str, buflen, "%lldK", rate / 1024);
+	else
+		return snprintf(str, buflen, "%.1fM",
+		    rate / (1024.0 * 1024.0));
+}
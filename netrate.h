@@ -0,0 +1,7 @@
+#define NETRATE_INTERVAL (2 * 1000)
+#define NETRATE_HISTORY 8
+
+int     netrate_init();
+int     netrate_route(int);
+int     netrate_up();
+char   *netrate_info();
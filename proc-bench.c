@@ -0,0 +1,314 @@
+/*
+ * proc-bench -- measures the per tick cost of reading a /proc tree
+ *
+ * usage: proc-bench [-n ticks]
+ *
+ * The values of the CPU, memory and load elements are read from a
+ * fake Linux style /proc tree in a temporary directory, once with
+ * fopen(3) and fscanf(3) on every tick, and once with the files kept
+ * open, read again with pread(2) into fixed buffers and parsed by hand.
+ * The parsed values are checked against the ones written, so a broken
+ * parser cannot look fast. This is the comparison for system-bench.c,
+ * which samples the same values through sysctl(2); unlike it, this
+ * program uses no OpenBSD interfaces and builds anywhere. Exits with 1
+ * on any error.
+ */
+
+#include <sys/types.h>
+#include <err.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_BUFLEN 4096
+
+/* The values in the fake tree, as a busy laptop would show them */
+#define FAKE_USER 4705
+#define FAKE_NICE 150
+#define FAKE_SYSTEM 1462
+#define FAKE_IDLE 2620531
+#define FAKE_TOTAL_KB 16303724
+#define FAKE_AVAILABLE_KB 11927372
+#define FAKE_LOAD_CENTI 57	/* 0.57 */
+
+static const char *stat_text =
+    "cpu  4705 150 1462 2620531 325 0 27 0 0 0\n"
+    "cpu0 1393 28 432 654217 86 0 19 0 0 0\n"
+    "cpu1 1112 41 349 655549 79 0 4 0 0 0\n"
+    "intr 114930548 113199788 3 0 5 263 0 4 [...]\n"
+    "ctxt 1990473\n"
+    "btime 1062191376\n";
+static const char *meminfo_text =
+    "MemTotal:       16303724 kB\n"
+    "MemFree:         9203804 kB\n"
+    "MemAvailable:   11927372 kB\n"
+    "Buffers:          203416 kB\n"
+    "Cached:          2901544 kB\n";
+static const char *loadavg_text = "0.57 0.61 0.58 2/612 31337\n";
+
+struct sample {
+	long long	busy;		/* cpu jiffies */
+	long long	total;
+	long long	used_kb;
+	long long	total_kb;
+	long long	load_centi;	/* 1-minute load * 100 */
+};
+
+static char dir[] = "/tmp/proc-bench.XXXXXXXXXX";
+static char stat_path[PATH_MAX], meminfo_path[PATH_MAX],
+    loadavg_path[PATH_MAX];
+
+static void	fake_tree();
+static void	fake_write(const char *, const char *);
+static int	stdio_sample(struct sample *);
+static int	pread_sample(int *, struct sample *);
+static ssize_t	pread_file(int, char *);
+static const char *parse_number(const char *, long long *);
+static const char *parse_field(const char *, const char *, long long *);
+static int	check(const char *, const struct sample *);
+static long long now();
+static void	report(const char *, int, long long);
+static void	usage();
+
+int
+main(int argc, char *argv[])
+{
+	struct sample s;
+	char *ep;
+	long long start;
+	long n;
+	int ch, i, ticks, failed, fds[3];
+
+	ticks = 100000;
+
+	while ((ch = getopt(argc, argv, "n:")) != -1) {
+		switch (ch) {
+		case 'n':
+			n = strtol(optarg, &ep, 10);
+			if (*optarg == '\0' || *ep != '\0' || n < 1 ||
+			    n > 100000000)
+				errx(1, "ticks %s: invalid", optarg);
+			ticks = n;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	printf("%-14s %9s %9s\n", "case", "ticks", "ns/tick");
+
+	fake_tree();
+
+	start = now();
+	for (i = 0; i < ticks; i++)
+		if (!stdio_sample(&s))
+			break;
+	report("proc stdio", i, now() - start);
+	failed = i < ticks || !check("proc stdio", &s);
+
+	if ((fds[0] = open(stat_path, O_RDONLY)) == -1 ||
+	    (fds[1] = open(meminfo_path, O_RDONLY)) == -1 ||
+	    (fds[2] = open(loadavg_path, O_RDONLY)) == -1)
+		err(1, "cannot open the fake tree");
+	start = now();
+	for (i = 0; i < ticks; i++)
+		if (!pread_sample(fds, &s))
+			break;
+	report("proc pread", i, now() - start);
+	failed |= i < ticks || !check("proc pread", &s);
+	for (i = 0; i < 3; i++)
+		close(fds[i]);
+
+	unlink(stat_path);
+	unlink(meminfo_path);
+	unlink(loadavg_path);
+	rmdir(dir);
+
+	return failed;
+}
+
+static void
+fake_tree()
+{
+	if (mkdtemp(dir) == NULL)
+		err(1, "cannot create a directory");
+	snprintf(stat_path, sizeof(stat_path), "%s/stat", dir);
+	snprintf(meminfo_path, sizeof(meminfo_path), "%s/meminfo", dir);
+	snprintf(loadavg_path, sizeof(loadavg_path), "%s/loadavg", dir);
+
+	fake_write(stat_path, stat_text);
+	fake_write(meminfo_path, meminfo_text);
+	fake_write(loadavg_path, loadavg_text);
+}
+
+static void
+fake_write(const char *path, const char *text)
+{
+	FILE *fp;
+
+	if ((fp = fopen(path, "w")) == NULL || fputs(text, fp) == EOF ||
+	    fclose(fp) == EOF)
+		err(1, "cannot write %s", path);
+}
+
+/* The naive way: every file is opened and scanned on every tick. */
+static int
+stdio_sample(struct sample *s)
+{
+	FILE *fp;
+	char key[32];
+	long long user, nice, sys, idle, value, available;
+	double load;
+	int n;
+
+	if ((fp = fopen(stat_path, "r")) == NULL)
+		return 0;
+	n = fscanf(fp, "cpu %lld %lld %lld %lld", &user, &nice, &sys, &idle);
+	fclose(fp);
+	if (n != 4)
+		return 0;
+	s->busy = user + nice + sys;
+	s->total = s->busy + idle;
+
+	if ((fp = fopen(meminfo_path, "r")) == NULL)
+		return 0;
+	s->total_kb = available = -1;
+	while (fscanf(fp, "%31s %lld kB", key, &value) == 2) {
+		if (strcmp(key, "MemTotal:") == 0)
+			s->total_kb = value;
+		else if (strcmp(key, "MemAvailable:") == 0)
+			available = value;
+	}
+	fclose(fp);
+	if (s->total_kb == -1 || available == -1)
+		return 0;
+	s->used_kb = s->total_kb - available;
+
+	if ((fp = fopen(loadavg_path, "r")) == NULL)
+		return 0;
+	n = fscanf(fp, "%lf", &load);
+	fclose(fp);
+	if (n != 1)
+		return 0;
+	s->load_centi = load * 100 + 0.5;
+
+	return 1;
+}
+
+/* The files are kept open and parsed without stdio. */
+static int
+pread_sample(int *fds, struct sample *s)
+{
+	static char buf[BENCH_BUFLEN];
+	long long v[4], available, frac;
+	const char *p;
+	int i;
+
+	if (pread_file(fds[0], buf) <= 0 || strncmp(buf, "cpu ", 4) != 0)
+		return 0;
+	for (p = buf + 4, i = 0; i < 4; i++)
+		if ((p = parse_number(p, &v[i])) == NULL)
+			return 0;
+	s->busy = v[0] + v[1] + v[2];
+	s->total = s->busy + v[3];
+
+	if (pread_file(fds[1], buf) <= 0 ||
+	    parse_field(buf, "MemTotal:", &s->total_kb) == NULL ||
+	    parse_field(buf, "MemAvailable:", &available) == NULL)
+		return 0;
+	s->used_kb = s->total_kb - available;
+
+	/* two decimals, as the kernel prints them */
+	if (pread_file(fds[2], buf) <= 0 ||
+	    (p = parse_number(buf, &v[0])) == NULL || *p != '.' ||
+	    parse_number(p + 1, &frac) == NULL)
+		return 0;
+	s->load_centi = v[0] * 100 + frac;
+
+	return 1;
+}
+
+static ssize_t
+pread_file(int fd, char *buf)
+{
+	ssize_t n;
+
+	if ((n = pread(fd, buf, BENCH_BUFLEN - 1, 0)) >= 0)
+		buf[n] = '\0';
+	return n;
+}
+
+/* Skips blanks and reads a decimal number; NULL if there is none. */
+static const char *
+parse_number(const char *p, long long *value)
+{
+	while (*p == ' ' || *p == '\t')
+		p++;
+	if (*p < '0' || *p > '9')
+		return NULL;
+
+	for (*value = 0; *p >= '0' && *p <= '9'; p++)
+		*value = *value * 10 + *p - '0';
+	return p;
+}
+
+/* Finds the line starting with key and reads its number. */
+static const char *
+parse_field(const char *buf, const char *key, long long *value)
+{
+	const char *p;
+	size_t len;
+
+	len = strlen(key);
+	for (p = buf; p != NULL && *p != '\0'; p = strchr(p, '\n')) {
+		if (*p == '\n')
+			p++;
+		if (strncmp(p, key, len) == 0)
+			return parse_number(p + len, value);
+	}
+
+	return NULL;
+}
+
+static int
+check(const char *name, const struct sample *s)
+{
+	if (s->busy == FAKE_USER + FAKE_NICE + FAKE_SYSTEM &&
+	    s->total == s->busy + FAKE_IDLE &&
+	    s->total_kb == FAKE_TOTAL_KB &&
+	    s->used_kb == FAKE_TOTAL_KB - FAKE_AVAILABLE_KB &&
+	    s->load_centi == FAKE_LOAD_CENTI)
+		return 1;
+
+	printf("%s: wrong values\n", name);
+	return 0;
+}
+
+static long long
+now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void
+report(const char *name, int ticks, long long elapsed)
+{
+	printf("%-14s %9d %9lld\n", name, ticks,
+	    ticks > 0 ? elapsed / ticks : 0);
+}
+
+static void
+usage()
+{
+	fprintf(stderr, "usage: proc-bench [-n ticks]\n");
+	exit(1);
+}
@@ -0,0 +1,252 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "query.h"
+#include "status.h"
+
+#define QUERY_SOCKET_FORMAT "/tmp/lemonbar-status.%u.sock"
+#define QUERY_MAX_CLIENTS 8
+#define QUERY_BUFLEN 32
+#define QUERY_BACKLOG 4
+
+#define SNAPSHOTSTR "snapshot"
+#define SUBSCRIBESTR "subscribe"
+#define UNKNOWNSTR "{\"error\":\"unknown request\"}\n"
+
+struct query_client {
+	int	fd;
+	int	subscribed;
+	size_t	len;
+	char	buf[QUERY_BUFLEN];
+};
+
+static struct query_client clients[QUERY_MAX_CLIENTS];
+static char socket_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static char last_json[STATUS_JSONLEN];
+static int subscribers = 0, initialized = 0;
+
+static struct query_client *query_find_client(int);
+static void	query_close_client(struct query_client *);
+static int	query_send(struct query_client *, const char *);
+
+/*
+ * Opens the listening socket. Clients send "snapshot" or "subscribe"
+ * terminated by a newline. A snapshot is a single line JSON object
+ * after which the connection is closed. Subscribers receive a snapshot
+ * immediately and another one every time a value changes.
+ */
+int
+query_init()
+{
+	struct sockaddr_un addr;
+	mode_t mask;
+	int fd, i;
+
+	if (initialized)
+		errx(1, "query_init called twice");
+
+	initialized = 1;
+
+	for (i = 0; i < QUERY_MAX_CLIENTS; i++)
+		clients[i].fd = -1;
+
+	snprintf(socket_path, sizeof(socket_path), QUERY_SOCKET_FORMAT,
+	    (unsigned)getuid());
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		warn("cannot create query socket");
+		goto cleanup_1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strlcpy(addr.sun_path, socket_path, sizeof(addr.sun_path));
+
+	unlink(socket_path);
+	mask = umask(0077);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		umask(mask);
+		warn("cannot bind %s", socket_path);
+		goto cleanup_2;
+	}
+	umask(mask);
+
+	if (listen(fd, QUERY_BACKLOG) == -1) {
+		warn("cannot listen on %s", socket_path);
+		goto cleanup_3;
+	}
+
+	return fd;
+
+cleanup_3:
+	unlink(socket_path);
+
+cleanup_2:
+	close(fd);
+
+cleanup_1:
+	return -1;
+}
+
+/*
+ * Accepts a pending connection. Returns the new client descriptor which
+ * has to be watched for reading or -1.
+ */
+int
+query_accept(int listen_fd)
+{
+	int fd, i;
+
+	if ((fd = accept(listen_fd, NULL, NULL)) == -1) {
+		warn("cannot accept query connection");
+		return -1;
+	}
+
+	for (i = 0; i < QUERY_MAX_CLIENTS && clients[i].fd != -1; i++)
+		;
+	if (i == QUERY_MAX_CLIENTS) {
+		warnx("too many query clients");
+		close(fd);
+		return -1;
+	}
+
+	if (fcntl(fd, F_SETFL, O_NONBLOCK) == -1) {
+		warn("cannot make query connection non-blocking");
+		close(fd);
+		return -1;
+	}
+
+	clients[i].fd = fd;
+	clients[i].subscribed = 0;
+	clients[i].len = 0;
+
+	return fd;
+}
+
+int
+query_is_client(int fd)
+{
+	return query_find_client(fd) != NULL;
+}
+
+void
+query_read(int fd)
+{
+	struct query_client *client;
+	const char *json;
+	char *nl;
+	ssize_t n;
+
+	if ((client = query_find_client(fd)) == NULL)
+		return;
+
+	n = read(fd, client->buf + client->len,
+	    sizeof(client->buf) - client->len - 1);
+	if (n == -1 && errno == EAGAIN)
+		return;
+	if (n <= 0) {
+		query_close_client(client);
+		return;
+	}
+	client->len += n;
+	client->buf[client->len] = '\0';
+
+	if ((nl = strchr(client->buf, '\n')) == NULL) {
+		if (client->len == sizeof(client->buf) - 1)
+			query_close_client(client);
+		return;
+	}
+	*nl = '\0';
+	client->len = 0;
+
+	if (client->subscribed)
+		return;
+
+	if (strcmp(client->buf, SNAPSHOTSTR) == 0) {
+		if ((json = status_json()) != NULL)
+			query_send(client, json);
+		query_close_client(client);
+	} else if (strcmp(client->buf, SUBSCRIBESTR) == 0) {
+		if ((json = status_json()) == NULL ||
+		    query_send(client, json) == -1)
+			return;
+		client->subscribed = 1;
+		subscribers++;
+		strlcpy(last_json, json, sizeof(last_json));
+	} else {
+		query_send(client, UNKNOWNSTR);
+		query_close_client(client);
+	}
+}
+
+/*
+ * Sends the current values to all subscribers if they have changed
+ * since the last notification.
+ */
+void
+query_notify()
+{
+	const char *json;
+	int i;
+
+	if (subscribers == 0)
+		return;
+
+	if ((json = status_json()) == NULL ||
+	    strcmp(json, last_json) == 0)
+		return;
+
+	strlcpy(last_json, json, sizeof(last_json));
+
+	for (i = 0; i < QUERY_MAX_CLIENTS; i++)
+		if (clients[i].fd != -1 && clients[i].subscribed)
+			query_send(&clients[i], json);
+}
+
+static struct query_client *
+query_find_client(int fd)
+{
+	int i;
+
+	for (i = 0; i < QUERY_MAX_CLIENTS; i++)
+		if (clients[i].fd == fd)
+			return &clients[i];
+
+	return NULL;
+}
+
+static void
+query_close_client(struct query_client *client)
+{
+	if (client->subscribed)
+		subscribers--;
+	close(client->fd);
+	client->fd = -1;
+	client->subscribed = 0;
+	client->len = 0;
+}
+
+/* Clients which cannot keep up are dropped instead of blocking the bar. */
+static int
+query_send(struct query_client *client, const char *json)
+{
+	size_t len;
+
+	len = strlen(json);
+	if (send(client->fd, json, len, MSG_NOSIGNAL) != (ssize_t)len ||
+	    (json[len - 1] != '\n' &&
+	    send(client->fd, "\n", 1, MSG_NOSIGNAL) != 1)) {
+		query_close_client(client);
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,5 @@
+int     query_init();
+int     query_accept(int);
+int     query_is_client(int);
+void    query_read(int);
+void    query_notify();
@@ -0,0 +1,353 @@
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "colors.h"
+#include "config.h"
+#include "filter.h"
+#include "health.h"
+#include "script.h"
+
+#define SCRIPT_BUFLEN 64
+#define SCRIPT_INFO_BUFLEN 256
+#define SCRIPT_MAX_CHILDREN 2
+#define SCRIPT_REAP_INTERVAL 100	/* ms */
+
+extern char **environ;
+
+struct script {
+	char		 command[CONFIG_URLLEN];
+	char		*argv[CONFIG_SCRIPT_ARGS + 1];	/* into command */
+	int		 interval;	/* ms */
+	int		 timeout;	/* ms */
+
+	pid_t		 pid;
+	int		 fd;
+	long long	 next_run;
+	long long	 deadline;
+	size_t		 len;
+	char		 buf[SCRIPT_BUFLEN];
+	char		 output[SCRIPT_BUFLEN];
+};
+
+/*
+ * The "script" lines of the configuration. The commands are searched
+ * for in $PATH like the weather script.
+ */
+static struct script scripts[CONFIG_MAX_SCRIPTS];
+static int nscripts = 0;
+
+static long long armed = -1;
+static int children = 0, initialized = 0;
+
+static void		script_load();
+static int		script_spawn(struct script *);
+static int		script_reap(struct script *, int);
+
+/* Returns the number of configured commands. */
+int
+script_init()
+{
+	if (initialized)
+		errx(1, "script_init called twice");
+
+	initialized = 1;
+
+	script_load();
+	return nscripts;
+}
+
+/*
+ * Replaces the commands by those of a changed configuration. Running
+ * commands are killed, their descriptors are closed. Returns the
+ * number of commands.
+ */
+int
+script_reload()
+{
+	struct script *s;
+	int i;
+
+	for (i = 0; i < nscripts; i++) {
+		s = &scripts[i];
+		if (s->pid == -1)
+			continue;
+		kill(s->pid, SIGKILL);
+		if (s->fd != -1)
+			close(s->fd);
+		script_reap(s, 1);
+	}
+
+	script_load();
+	armed = -1;
+	return nscripts;
+}
+
+static void
+script_load()
+{
+	struct script *s;
+	char *p;
+	long long now;
+	int i, n;
+
+	now = filter_now();
+	memset(scripts, 0, sizeof(scripts));
+	nscripts = config->nscripts;
+
+	for (i = 0; i < nscripts; i++) {
+		s = &scripts[i];
+		strlcpy(s->command, config->scripts[i].command,
+		    sizeof(s->command));
+		p = s->command;
+		for (n = 0; n < CONFIG_SCRIPT_ARGS &&
+		    (s->argv[n] = strsep(&p, " ")) != NULL; n++)
+			;
+		s->argv[n] = NULL;
+		s->interval = config->scripts[i].interval;
+		s->timeout = config->scripts[i].timeout;
+		s->pid = -1;
+		s->fd = -1;
+		s->next_run = now;
+	}
+}
+
+/*
+ * Kills commands which have exceeded their timeout and starts those
+ * which are due, as long as fewer than SCRIPT_MAX_CHILDREN are running.
+ * The read ends of the new pipes are stored in fds. Returns their
+ * number.
+ */
+int
+script_run(int *fds, int max)
+{
+	struct script *s;
+	long long now;
+	int i, n;
+
+	now = filter_now();
+	n = 0;
+
+	for (i = 0; i < nscripts; i++) {
+		s = &scripts[i];
+		if (s->pid == -1 || (s->fd == -1 && script_reap(s, 0)))
+			continue;
+		if (now >= s->deadline) {
+			health_warnx(HEALTH_SCRIPTS, "%s timed out",
+			    s->argv[0]);
+			kill(s->pid, SIGKILL);
+			if (s->fd != -1) {
+				close(s->fd);
+				s->fd = -1;
+			}
+			script_reap(s, 1);
+		}
+	}
+
+	for (i = 0; i < nscripts && n < max; i++) {
+		s = &scripts[i];
+		if (s->pid != -1 || now < s->next_run ||
+		    children >= SCRIPT_MAX_CHILDREN)
+			continue;
+		s->next_run = now + s->interval;
+		if (script_spawn(s))
+			fds[n++] = s->fd;
+	}
+
+	return n;
+}
+
+/*
+ * Returns 1 and the milliseconds until script_run() has to be called
+ * again if this time has changed since the last call.
+ */
+int
+script_timeout(int *timeout)
+{
+	long long now, next;
+	int i;
+
+	now = filter_now();
+	next = now + 3600 * 1000;
+
+	for (i = 0; i < nscripts; i++) {
+		if (scripts[i].pid != -1 && scripts[i].fd == -1) {
+			/* output complete, waiting for the exit status */
+			if (now + SCRIPT_REAP_INTERVAL < next)
+				next = now + SCRIPT_REAP_INTERVAL;
+		} else if (scripts[i].pid != -1) {
+			if (scripts[i].deadline < next)
+				next = scripts[i].deadline;
+		} else if (scripts[i].next_run < next)
+			next = scripts[i].next_run;
+	}
+
+	if (next == armed)
+		return 0;
+	armed = next;
+
+	*timeout = next > now ? next - now : 1;
+	return 1;
+}
+
+int
+script_is_fd(int fd)
+{
+	int i;
+
+	for (i = 0; i < nscripts; i++)
+		if (scripts[i].fd != -1 && scripts[i].fd == fd)
+			return 1;
+
+	return 0;
+}
+
+/*
+ * Reads the output of a command. Returns 1 if the command has finished
+ * and its output differs from the cached one.
+ */
+int
+script_read(int fd)
+{
+	struct script *s;
+	char discard[SCRIPT_BUFLEN];
+	ssize_t n;
+	int i;
+
+	for (i = 0; i < nscripts && scripts[i].fd != fd; i++)
+		;
+	if (i == nscripts)
+		return 0;
+	s = &scripts[i];
+
+	for (;;) {
+		if (s->len < sizeof(s->buf) - 1)
+			n = read(fd, s->buf + s->len,
+			    sizeof(s->buf) - s->len - 1);
+		else
+			n = read(fd, discard, sizeof(discard));
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1 && errno == EAGAIN)
+			return 0;
+		if (n <= 0)
+			break;
+		if (s->len < sizeof(s->buf) - 1)
+			s->len += n;
+	}
+
+	close(s->fd);
+	s->fd = -1;
+	script_reap(s, 0);
+
+	s->buf[s->len] = '\0';
+	s->buf[strcspn(s->buf, "\n")] = '\0';
+	if (strcmp(s->buf, s->output) == 0)
+		return 0;
+
+	strlcpy(s->output, s->buf, sizeof(s->output));
+	return 1;
+}
+
+/* The non-empty outputs separated like the other elements. */
+char *
+script_info()
+{
+	static char str[SCRIPT_INFO_BUFLEN];
+	int i;
+
+	str[0] = '\0';
+
+	for (i = 0; i < nscripts; i++) {
+		if (scripts[i].output[0] == '\0')
+			continue;
+		if (str[0] != '\0')
+			strlcat(str, " " SEPARATOR_COLOR "|" NORMAL_COLOR " ",
+			    sizeof(str));
+		strlcat(str, scripts[i].output, sizeof(str));
+	}
+
+	return str[0] != '\0' ? str : NULL;
+}
+
+static int
+script_spawn(struct script *s)
+{
+	posix_spawn_file_actions_t actions;
+	int pipe_fd[2], res = 0;
+
+	if (pipe2(pipe_fd, O_CLOEXEC) == -1) {
+		health_warn(HEALTH_SCRIPTS, "cannot create pipe for %s",
+		    s->argv[0]);
+		goto cleanup_1;
+	}
+
+	if (fcntl(pipe_fd[0], F_SETFL, O_NONBLOCK) == -1) {
+		health_warn(HEALTH_SCRIPTS, "cannot make pipe non-blocking");
+		goto cleanup_2;
+	}
+
+	if ((errno = posix_spawn_file_actions_init(&actions)) != 0) {
+		health_warn(HEALTH_SCRIPTS, "cannot spawn %s", s->argv[0]);
+		goto cleanup_2;
+	}
+
+	if ((errno = posix_spawn_file_actions_addopen(&actions,
+	    STDIN_FILENO, "/dev/null", O_RDONLY, 0)) != 0 ||
+	    (errno = posix_spawn_file_actions_adddup2(&actions,
+	    pipe_fd[1], STDOUT_FILENO)) != 0) {
+		health_warn(HEALTH_SCRIPTS, "cannot spawn %s", s->argv[0]);
+		goto cleanup_3;
+	}
+
+	if ((errno = posix_spawnp(&s->pid, s->argv[0], &actions, NULL,
+	    s->argv, environ)) != 0) {
+		health_warn(HEALTH_SCRIPTS, "cannot spawn %s", s->argv[0]);
+		s->pid = -1;
+		goto cleanup_3;
+	}
+
+	children++;
+	s->fd = pipe_fd[0];
+	s->len = 0;
+	s->deadline = filter_now() + s->timeout;
+	res = 1;
+
+cleanup_3:
+	posix_spawn_file_actions_destroy(&actions);
+
+cleanup_2:
+	close(pipe_fd[1]);
+	if (!res)
+		close(pipe_fd[0]);
+
+cleanup_1:
+	return res;
+}
+
+/*
+ * Collects the exit status, blocking only if block is set. Returns 1 if
+ * the command has terminated.
+ */
+static int
+script_reap(struct script *s, int block)
+{
+	int st;
+
+	if (waitpid(s->pid, &st, block ? 0 : WNOHANG) <= 0)
+		return 0;
+
+	if (WIFEXITED(st) && WEXITSTATUS(st) != 0)
+		health_warnx(HEALTH_SCRIPTS, "%s exited with status %d",
+		    s->argv[0], WEXITSTATUS(st));
+
+	s->pid = -1;
+	children--;
+	return 1;
+}
@@ -0,0 +1,7 @@
+int     script_init();
+int     script_reload();
+int     script_run(int *, int);
+int     script_timeout(int *);
+int     script_is_fd(int);
+int     script_read(int);
+char   *script_info();
@@ -0,0 +1,233 @@
+/*
+ * snapshot-torture -- checks the snapshot protocol under load
+ *
+ * usage: snapshot-torture [-r readers] [-s seconds]
+ *
+ * One thread publishes snapshots as fast as it can with the writer of
+ * lemonbar-status, while the readers copy them with the reader
+ * library. Every published snapshot carries one counter in all its
+ * segments and in the typed values, so a torn copy shows up as a
+ * mismatch. Finally a writer which died during an update is simulated,
+ * which snapshot_read() has to give up on. Exits with 1 on any error.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+#define TORTURE_MAX_READERS 16
+
+struct status status;
+
+static char path[PATH_MAX];
+static atomic_int stop;
+
+struct reader {
+	pthread_t	 thread;
+	unsigned long	 reads;
+	unsigned long	 errors;
+};
+
+static void    *writer(void *);
+static void    *reader(void *);
+static int	dead_writer();
+static void	usage();
+
+int
+main(int argc, char *argv[])
+{
+	struct reader readers[TORTURE_MAX_READERS];
+	pthread_t thread;
+	char dir[] = "/tmp/snapshot-torture.XXXXXXXXXX";
+	const char *errstr;
+	unsigned long reads, errors;
+	int ch, i, nreaders, seconds;
+
+	nreaders = 4;
+	seconds = 5;
+
+	while ((ch = getopt(argc, argv, "r:s:")) != -1) {
+		switch (ch) {
+		case 'r':
+			nreaders = strtonum(optarg, 1, TORTURE_MAX_READERS,
+			    &errstr);
+			if (errstr != NULL)
+				errx(1, "readers %s: %s", optarg, errstr);
+			break;
+		case 's':
+			seconds = strtonum(optarg, 1, 3600, &errstr);
+			if (errstr != NULL)
+				errx(1, "seconds %s: %s", optarg, errstr);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	if (mkdtemp(dir) == NULL)
+		err(1, "cannot create a directory");
+	snprintf(path, sizeof(path), "%s/snapshot", dir);
+
+	if (!snapshot_init(path))
+		errx(1, "cannot create %s", path);
+
+	if (pthread_create(&thread, NULL, writer, NULL) != 0)
+		errx(1, "cannot start the writer");
+	for (i = 0; i < nreaders; i++) {
+		readers[i].reads = readers[i].errors = 0;
+		if (pthread_create(&readers[i].thread, NULL, reader,
+		    &readers[i]) != 0)
+			errx(1, "cannot start a reader");
+	}
+
+	sleep(seconds);
+	atomic_store(&stop, 1);
+
+	reads = errors = 0;
+	for (i = 0; i < nreaders; i++) {
+		pthread_join(readers[i].thread, NULL);
+		reads += readers[i].reads;
+		errors += readers[i].errors;
+	}
+	pthread_join(thread, NULL);
+
+	printf("%lu reads by %d readers, %lu torn\n", reads, nreaders, errors);
+
+	if (!dead_writer()) {
+		printf("a dead writer blocks the readers\n");
+		errors++;
+	}
+
+	unlink(path);
+	rmdir(dir);
+
+	return errors > 0;
+}
+
+/* Publishes the counter k in every segment and in some typed values. */
+static void *
+writer(void *arg)
+{
+	static char segments[INFO_ARRAY_SIZE][SNAPSHOT_SEGLEN];
+	char *infos[INFO_ARRAY_SIZE];
+	unsigned int k;
+	int i;
+
+	(void)arg;
+
+	for (k = 0; !atomic_load(&stop); k++) {
+		for (i = 0; i < INFO_ARRAY_SIZE; i++) {
+			/* varying lengths move the terminating zeros */
+			snprintf(segments[i], SNAPSHOT_SEGLEN, "%u %.*s", k,
+			    (int)(k % (SNAPSHOT_SEGLEN - 16)),
+			    "................................................"
+			    "................................................"
+			    "................................................"
+			    "................................................"
+			    "................................................");
+			infos[i] = segments[i];
+		}
+		status.battery.percent = k;
+		status.battery.minutes = k;
+		status.clock.valid = k;
+		snapshot_publish(infos);
+	}
+
+	return NULL;
+}
+
+static void *
+reader(void *arg)
+{
+	static struct snapshot copies[TORTURE_MAX_READERS];
+	static atomic_int next;
+	struct reader *r = arg;
+	const struct snapshot *snapshot;
+	struct snapshot *copy;
+	unsigned int k, last;
+	int i;
+
+	copy = &copies[atomic_fetch_add(&next, 1)];
+	if ((snapshot = snapshot_open(path)) == NULL)
+		err(1, "cannot open %s", path);
+
+	last = 0;
+	while (!atomic_load(&stop)) {
+		if (!snapshot_read(snapshot, copy)) {
+			warn("cannot read the snapshot");
+			r->errors++;
+			continue;
+		}
+		r->reads++;
+
+		k = strtoul(copy->segments[0], NULL, 10);
+		if (k < last || atomic_load(&copy->seq) & 1 ||
+		    (unsigned int)copy->status.battery.percent != k ||
+		    (unsigned int)copy->status.battery.minutes != k ||
+		    (unsigned int)copy->status.clock.valid != k) {
+			r->errors++;
+			continue;
+		}
+		for (i = 1; i < INFO_ARRAY_SIZE; i++)
+			if (strcmp(copy->segments[i], copy->segments[0]) != 0)
+				break;
+		if (i < INFO_ARRAY_SIZE)
+			r->errors++;
+		last = k;
+	}
+
+	snapshot_close(snapshot);
+	return NULL;
+}
+
+/*
+ * Leaves the counter odd, as a writer killed during an update would.
+ * Returns 1 if the reader gives up instead of spinning forever.
+ */
+static int
+dead_writer()
+{
+	static struct snapshot copy;
+	const struct snapshot *snapshot;
+	struct snapshot *p;
+	int fd, res;
+
+	if ((fd = open(path, O_RDWR)) == -1)
+		err(1, "cannot open %s", path);
+	p = mmap(NULL, sizeof(*p), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		err(1, "cannot map %s", path);
+	close(fd);
+
+	atomic_fetch_add(&p->seq, 1);
+
+	if ((snapshot = snapshot_open(path)) == NULL)
+		err(1, "cannot open %s", path);
+	res = !snapshot_read(snapshot, &copy) && errno == EAGAIN;
+	snapshot_close(snapshot);
+
+	atomic_fetch_add(&p->seq, 1);
+	munmap(p, sizeof(*p));
+
+	return res;
+}
+
+static void
+usage()
+{
+	fprintf(stderr, "usage: snapshot-torture [-r readers] [-s seconds]\n");
+	exit(1);
+}
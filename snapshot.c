@@ -0,0 +1,152 @@
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <err.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+static struct snapshot *snapshot = NULL;
+
+static int	snapshot_owned(int, const char *);
+
+/*
+ * Creates the snapshot file at path, see snapshot_path(), and maps it.
+ * Readers map the same file read-only with snapshot_open().
+ */
+int
+snapshot_init(const char *path)
+{
+	char dir[PATH_MAX], *slash;
+	void *p;
+	int fd, res = 0;
+
+	if (snapshot != NULL)
+		errx(1, "snapshot_init called twice");
+
+	strlcpy(dir, path, sizeof(dir));
+	if ((slash = strrchr(dir, '/')) != NULL) {
+		*slash = '\0';
+		mkdir(dir, 0700);
+	}
+
+	if ((fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC,
+	    0600)) == -1) {
+		warn("cannot open %s", path);
+		goto cleanup_1;
+	}
+
+	/* an older version has created it readable for everyone */
+	if (!snapshot_owned(fd, path) || fchmod(fd, 0600) == -1)
+		goto cleanup_2;
+
+	if (ftruncate(fd, sizeof(struct snapshot)) == -1) {
+		warn("cannot resize %s", path);
+		goto cleanup_2;
+	}
+
+	p = mmap(NULL, sizeof(struct snapshot), PROT_READ | PROT_WRITE,
+	    MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		warn("cannot map %s", path);
+		goto cleanup_2;
+	}
+	snapshot = p;
+
+	atomic_store(&snapshot->seq, 0);
+	snapshot->version = SNAPSHOT_VERSION;
+	snapshot->nsegments = INFO_ARRAY_SIZE;
+	snapshot->magic = SNAPSHOT_MAGIC;
+
+	res = 1;
+
+cleanup_2:
+	close(fd);
+
+cleanup_1:
+	return res;
+}
+
+/* Copies the current segments and typed values into the mapping. */
+void
+snapshot_publish(char *infos[])
+{
+	unsigned int seq;
+	int i;
+
+	if (snapshot == NULL)
+		return;
+
+	seq = atomic_load_explicit(&snapshot->seq, memory_order_relaxed);
+	atomic_store_explicit(&snapshot->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	memcpy(&snapshot->status, &status, sizeof(status));
+	for (i = 0; i < INFO_ARRAY_SIZE; i++)
+		strlcpy(snapshot->segments[i], infos[i] ? infos[i] : "",
+		    SNAPSHOT_SEGLEN);
+
+	atomic_store_explicit(&snapshot->seq, seq + 2, memory_order_release);
+}
+
+/*
+ * Reads back what the previous image has published before it was
+ * replaced by a re-exec: the segments into segments and the typed
+ * values into the status. Has to be called before snapshot_init().
+ * Returns 1 on success.
+ */
+int
+snapshot_restore(const char *path, char segments[][SNAPSHOT_SEGLEN])
+{
+	static struct snapshot copy;
+	int fd, res = 0;
+
+	if ((fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)) == -1) {
+		warn("cannot open %s", path);
+		goto cleanup_1;
+	}
+	if (!snapshot_owned(fd, path))
+		goto cleanup_2;
+
+	/* the writer is gone, so no update can be in progress */
+	if (read(fd, &copy, sizeof(copy)) != sizeof(copy) ||
+	    copy.magic != SNAPSHOT_MAGIC ||
+	    copy.version != SNAPSHOT_VERSION ||
+	    copy.nsegments != INFO_ARRAY_SIZE ||
+	    atomic_load(&copy.seq) & 1) {
+		warnx("no snapshot to restore in %s", path);
+		goto cleanup_2;
+	}
+
+	memcpy(&status, &copy.status, sizeof(status));
+	memcpy(segments, copy.segments, sizeof(copy.segments));
+
+	res = 1;
+
+cleanup_2:
+	close(fd);
+
+cleanup_1:
+	return res;
+}
+
+/* Accepts only a regular file of the user, nothing planted by others. */
+static int
+snapshot_owned(int fd, const char *path)
+{
+	struct stat st;
+
+	if (fstat(fd, &st) == -1) {
+		warn("cannot stat %s", path);
+		return 0;
+	}
+	if (!S_ISREG(st.st_mode) || st.st_uid != getuid()) {
+		warnx("%s is not a file of the user", path);
+		return 0;
+	}
+
+	return 1;
+}
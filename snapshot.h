@@ -0,0 +1,46 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "status.h"
+
+/* In $XDG_RUNTIME_DIR, or below $HOME without it */
+#define SNAPSHOT_RUNTIME_FILE "/lemonbar-status.shm"
+#define SNAPSHOT_HOME_PATH "/.cache/lemonbar-status/snapshot"
+#define SNAPSHOT_MAGIC 0x6c627374	/* "lbst" */
+#define SNAPSHOT_VERSION 4
+#define SNAPSHOT_SEGLEN 256
+#define SNAPSHOT_RETRIES 100000	/* before a writer is considered dead */
+
+/*
+ * Layout of the memory mapped snapshot file. The writer increments seq
+ * before and after every update, so it is odd while an update is in
+ * progress. A reader copies the data and retries if seq was odd or has
+ * changed in the meantime.
+ */
+struct snapshot {
+	uint32_t	magic;
+	uint32_t	version;
+	atomic_uint	seq;
+	uint32_t	nsegments;
+	struct status	status;
+	char		segments[INFO_ARRAY_SIZE][SNAPSHOT_SEGLEN];
+};
+
+/* Writer, used by lemonbar-status itself */
+
+int	snapshot_init(const char *);
+void	snapshot_publish(char **);
+int	snapshot_restore(const char *, char [][SNAPSHOT_SEGLEN]);
+
+/* Reader library */
+
+int			snapshot_path(char *, size_t);
+const struct snapshot  *snapshot_open(const char *);
+int			snapshot_read(const struct snapshot *,
+			    struct snapshot *);
+void			snapshot_close(const struct snapshot *);
+
+#endif /* SNAPSHOT_H */
@@ -0,0 +1,130 @@
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+/*
+ * Stores the path of the snapshot file of the user in path: in
+ * $XDG_RUNTIME_DIR, which only the user can access, or in the cache
+ * directory below $HOME. Returns 0 and sets errno if neither is set or
+ * the path is too long.
+ */
+int
+snapshot_path(char *path, size_t size)
+{
+	char *dir;
+	int n;
+
+	if ((dir = getenv("XDG_RUNTIME_DIR")) != NULL && dir[0] != '\0')
+		n = snprintf(path, size, "%s" SNAPSHOT_RUNTIME_FILE, dir);
+	else if ((dir = getenv("HOME")) != NULL)
+		n = snprintf(path, size, "%s" SNAPSHOT_HOME_PATH, dir);
+	else {
+		errno = ENOENT;
+		return 0;
+	}
+
+	if (n < 0 || (size_t)n >= size) {
+		errno = ENAMETOOLONG;
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Maps the snapshot file written by lemonbar-status read-only. Returns
+ * NULL and sets errno if the file cannot be mapped or has an unknown
+ * layout. No system calls are needed to read the mapping afterwards.
+ */
+const struct snapshot *
+snapshot_open(const char *path)
+{
+	const struct snapshot *snapshot;
+	struct stat st;
+	void *p;
+	int fd, saved_errno;
+
+	if ((fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)) == -1)
+		return NULL;
+
+	if (fstat(fd, &st) == -1)
+		goto fail;
+
+	if (!S_ISREG(st.st_mode) ||
+	    st.st_size < (off_t)sizeof(struct snapshot)) {
+		errno = EINVAL;
+		goto fail;
+	}
+
+	p = mmap(NULL, sizeof(struct snapshot), PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		goto fail;
+	close(fd);
+
+	snapshot = p;
+	if (snapshot->magic != SNAPSHOT_MAGIC ||
+	    snapshot->version != SNAPSHOT_VERSION ||
+	    snapshot->nsegments != INFO_ARRAY_SIZE) {
+		munmap(p, sizeof(struct snapshot));
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return snapshot;
+
+fail:
+	saved_errno = errno;
+	close(fd);
+	errno = saved_errno;
+	return NULL;
+}
+
+/*
+ * Copies a consistent snapshot into copy. The copy is retried while the
+ * writer is updating the mapping, so this never blocks on a lock. A
+ * writer which has died in the middle of an update would leave the
+ * counter odd forever, so after SNAPSHOT_RETRIES attempts 0 is returned
+ * with errno set to EAGAIN. Returns 1 on success.
+ */
+int
+snapshot_read(const struct snapshot *snapshot, struct snapshot *copy)
+{
+	unsigned int seq1, seq2;
+	int i;
+
+	for (i = 0; i < SNAPSHOT_RETRIES; i++) {
+		seq1 = atomic_load_explicit((atomic_uint *)&snapshot->seq,
+		    memory_order_acquire);
+		if (seq1 & 1) {
+			sched_yield();
+			continue;
+		}
+		memcpy(copy, snapshot, sizeof(struct snapshot));
+		atomic_thread_fence(memory_order_acquire);
+		seq2 = atomic_load_explicit((atomic_uint *)&snapshot->seq,
+		    memory_order_relaxed);
+		if (seq1 == seq2) {
+			atomic_store_explicit(&copy->seq, seq1,
+			    memory_order_relaxed);
+			return 1;
+		}
+	}
+
+	errno = EAGAIN;
+	return 0;
+}
+
+void
+snapshot_close(const struct snapshot *snapshot)
+{
+	munmap((void *)snapshot, sizeof(struct snapshot));
+}
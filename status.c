@@ -0,0 +1,257 @@
+#include <err.h>
+#include <string.h>
+#include <json-c/json.h>
+
+#include "status.h"
+
+struct status status;
+
+/*
+ * Names of the elements, used for i3bar blocks, click events and the
+ * layout in the configuration file.
+ */
+const char *status_names[INFO_ARRAY_SIZE] = {
+	[INFO_WINDOW] = "window",
+	[INFO_MPD] = "mpd",
+	[INFO_MAIL] = "mail",
+	[INFO_SCRIPTS] = "scripts",
+	[INFO_LOAD] = "load",
+	[INFO_CPU] = "cpu",
+	[INFO_MEMORY] = "memory",
+	[INFO_NETWORK] = "network",
+	[INFO_NETRATE] = "throughput",
+	[INFO_BATTERY] = "battery",
+	[INFO_FS] = "filesystems",
+	[INFO_THERMAL] = "thermal",
+	[INFO_KEYBOARD] = "keyboard",
+	[INFO_BRIGHTNESS] = "brightness",
+	[INFO_AUDIO] = "audio",
+	[INFO_WEATHER] = "weather",
+	[INFO_CLOCK] = "clock"
+};
+
+static const char *mpd_state_names[] = { "unknown", "stop", "play",
+    "pause" };
+
+/* Returns the element of a name or -1. */
+int
+status_element(const char *name)
+{
+	int i;
+
+	for (i = 0; i < INFO_ARRAY_SIZE; i++)
+		if (status_names[i] != NULL &&
+		    strcmp(status_names[i], name) == 0)
+			return i;
+
+	return -1;
+}
+
+/*
+ * Serializes the cached values into a single line JSON object. Sources
+ * without valid data are represented by null. No information source
+ * is queried.
+ */
+const char *
+status_json()
+{
+	static char str[STATUS_JSONLEN];
+	struct json_object *obj, *sub, *fs;
+	const char *res = NULL;
+	int i;
+
+	if ((obj = json_object_new_object()) == NULL) {
+		warnx("cannot create JSON object");
+		return NULL;
+	}
+
+	sub = NULL;
+	if (status.window.valid) {
+		sub = json_object_new_object();
+		json_object_object_add(sub, "title",
+		    json_object_new_string(status.window.title));
+	}
+	json_object_object_add(obj, "window", sub);
+
+	sub = NULL;
+	if (status.mpd.valid) {
+		sub = json_object_new_object();
+		json_object_object_add(sub, "state",
+		    json_object_new_string(mpd_state_names[status.mpd.state]));
+		json_object_object_add(sub, "name",
+		    json_object_new_string(status.mpd.name));
+		json_object_object_add(sub, "title",
+		    json_object_new_string(status.mpd.title));
+		json_object_object_add(sub, "volume",
+		    status.mpd.volume < 0 ? NULL :
+		    json_object_new_int(status.mpd.volume));
+		json_object_object_add(sub, "repeat",
+		    json_object_new_boolean(status.mpd.repeat));
+		json_object_object_add(sub, "random",
+		    json_object_new_boolean(status.mpd.random));
+		json_object_object_add(sub, "single",
+		    json_object_new_boolean(status.mpd.single));
+		json_object_object_add(sub, "consume",
+		    json_object_new_boolean(status.mpd.consume));
+		json_object_object_add(sub, "outputs",
+		    status.mpd.outputs < 0 ? NULL :
+		    json_object_new_int(status.mpd.outputs));
+	}
+	json_object_object_add(obj, "mpd", sub);
+
+	sub = NULL;
+	if (status.mail.valid) {
+		sub = json_object_new_object();
+		json_object_object_add(sub, "unread",
+		    json_object_new_boolean(status.mail.unread));
+	}
+	json_object_object_add(obj, "mail", sub);
+
+	sub = NULL;
+	if (status.load.valid) {
+		sub = json_object_new_array();
+		for (i = 0; i < 3; i++)
+			json_object_array_add(sub,
+			    json_object_new_double(status.load.average[i]));
+	}
+	json_object_object_add(obj, "load", sub);
+
+	sub = NULL;
+	if (status.cpu.valid) {
+		sub = json_object_new_object();
+		json_object_object_add(sub, "percent",
+		    json_object_new_int(status.cpu.percent));
+	}
+	json_object_object_add(obj, "cpu", sub);
+
+	sub = NULL;
+	if (status.memory.valid) {
+		sub = json_object_new_object();
+		json_object_object_add(sub, "used",
+		    json_object_new_int64(status.memory.used));
+		json_object_object_add(sub, "total",
+		    json_object_new_int64(status.memory.total));
+	}
+	json_object_object_add(obj, "memory", sub);
+
+	sub = NULL;
+	if (status.net.valid) {
+		sub = json_object_new_object();
+		json_object_object_add(sub, "interface",
+		    json_object_new_string(status.net.interface));
+		json_object_object_add(sub, "address",
+		    json_object_new_string(status.net.address));
+	}
+	json_object_object_add(obj, "network", sub);
+
+	sub = NULL;
+	if (status.netrate.valid) {
+		sub = json_object_new_object();
+		json_object_object_add(sub, "rx",
+		    json_object_new_int64(status.netrate.rx));
+		json_object_object_add(sub, "tx",
+		    json_object_new_int64(status.netrate.tx));
+	}
+	json_object_object_add(obj, "throughput", sub);
+
+	sub = NULL;
+	if (status.battery.valid) {
+		sub = json_object_new_object();
+		json_object_object_add(sub, "ac",
+		    json_object_new_boolean(status.battery.ac));
+		json_object_object_add(sub, "percent",
+		    json_object_new_int(status.battery.percent));
+		json_object_object_add(sub, "minutes",
+		    status.battery.minutes < 0 ? NULL :
+		    json_object_new_int(status.battery.minutes));
+	}
+	json_object_object_add(obj, "battery", sub);
+
+	sub = json_object_new_array();
+	for (i = 0; i < STATUS_FS_MAX; i++) {
+		if (!status.fs[i].valid)
+			continue;
+		fs = json_object_new_object();
+		json_object_object_add(fs, "path",
+		    json_object_new_string(status.fs[i].path));
+		json_object_object_add(fs, "percent",
+		    json_object_new_int(status.fs[i].percent));
+		json_object_object_add(fs, "free",
+		    json_object_new_int64(status.fs[i].free));
+		json_object_array_add(sub, fs);
+	}
+	json_object_object_add(obj, "filesystems", sub);
+
+	sub = NULL;
+	if (status.thermal.valid) {
+		sub = json_object_new_object();
+		json_object_object_add(sub, "temperature",
+		    json_object_new_double(status.thermal.temperature));
+		json_object_object_add(sub, "fan",
+		    status.thermal.fan < 0 ? NULL :
+		    json_object_new_int64(status.thermal.fan));
+	}
+	json_object_object_add(obj, "thermal", sub);
+
+	sub = NULL;
+	if (status.keyboard.valid) {
+		sub = json_object_new_object();
+		json_object_object_add(sub, "layout",
+		    json_object_new_string(status.keyboard.layout));
+		json_object_object_add(sub, "caps",
+		    json_object_new_boolean(status.keyboard.caps));
+		json_object_object_add(sub, "num",
+		    json_object_new_boolean(status.keyboard.num));
+	}
+	json_object_object_add(obj, "keyboard", sub);
+
+	sub = NULL;
+	if (status.brightness.valid) {
+		sub = json_object_new_object();
+		json_object_object_add(sub, "percent",
+		    json_object_new_int(status.brightness.percent));
+	}
+	json_object_object_add(obj, "brightness", sub);
+
+	sub = NULL;
+	if (status.audio.valid) {
+		sub = json_object_new_object();
+		json_object_object_add(sub, "muted",
+		    json_object_new_boolean(status.audio.muted));
+		json_object_object_add(sub, "left",
+		    json_object_new_int(status.audio.left));
+		json_object_object_add(sub, "right",
+		    json_object_new_int(status.audio.right));
+	}
+	json_object_object_add(obj, "audio", sub);
+
+	sub = NULL;
+	if (status.weather.valid) {
+		sub = json_object_new_object();
+		json_object_object_add(sub, "temperature",
+		    json_object_new_double(status.weather.temperature));
+		json_object_object_add(sub, "description",
+		    json_object_new_string(status.weather.description));
+	}
+	json_object_object_add(obj, "weather", sub);
+
+	sub = NULL;
+	if (status.clock.valid) {
+		sub = json_object_new_object();
+		json_object_object_add(sub, "time",
+		    json_object_new_int64(status.clock.time));
+	}
+	json_object_object_add(obj, "clock", sub);
+
+	if (strlcpy(str, json_object_to_json_string_ext(obj,
+	    JSON_C_TO_STRING_PLAIN), sizeof(str)) >= sizeof(str)) {
+		warnx("status JSON too long");
+		goto cleanup;
+	}
+
+	res = str;
+
+cleanup:
+	json_object_put(obj);
+	return res;
+}
@@ -0,0 +1,118 @@
+#ifndef STATUS_H
+#define STATUS_H
+
+#define STATUS_STRLEN 128
+#define STATUS_JSONLEN 2048
+#define STATUS_FS_MAX 4
+
+enum infos { INFO_WINDOW, INFO_MPD, INFO_MAIL, INFO_SCRIPTS, INFO_LOAD, INFO_CPU,
+    INFO_MEMORY, INFO_NETWORK, INFO_NETRATE, INFO_BATTERY,
+    INFO_FS, INFO_THERMAL, INFO_KEYBOARD, INFO_BRIGHTNESS, INFO_AUDIO,
+    INFO_WEATHER, INFO_CLOCK, INFO_ARRAY_SIZE };
+
+enum mpd_state { MPD_STATE_UNKNOWN, MPD_STATE_STOP, MPD_STATE_PLAY,
+    MPD_STATE_PAUSE };
+
+/*
+ * Typed values of the information sources. Every *_info() function
+ * fills in its member before formatting its string, so the values
+ * here always correspond to the last line written to standard output;
+ * filtered sources keep the displayed values, not the raw samples.
+ * Sources refreshed on the worker pool fill in a copy of their member,
+ * which is taken over by the main thread together with the string.
+ */
+struct status {
+	struct status_window {
+		int		valid;
+		char		title[STATUS_STRLEN];
+	} window;
+	struct status_mpd {
+		int		valid;
+		enum mpd_state	state;
+		char		name[STATUS_STRLEN];
+		char		title[STATUS_STRLEN];
+		int		volume;		/* -1 without mixer */
+		int		repeat;
+		int		random;
+		int		single;
+		int		consume;
+		int		outputs;	/* enabled, -1 if unknown */
+	} mpd;
+	struct {
+		int		valid;
+		int		unread;
+	} mail;
+	struct {
+		int		valid;
+		double		average[3];
+	} load;
+	struct {
+		int		valid;
+		int		percent;
+	} cpu;
+	struct {
+		int		valid;
+		long long	used;		/* MiB */
+		long long	total;		/* MiB */
+	} memory;
+	struct {
+		int		valid;
+		char		interface[STATUS_STRLEN];
+		char		address[STATUS_STRLEN];
+	} net;
+	struct {
+		int		valid;
+		long long	rx;		/* bytes/s */
+		long long	tx;		/* bytes/s */
+	} netrate;
+	struct {
+		int		valid;
+		int		ac;
+		int		percent;
+		int		minutes;	/* -1 if unknown */
+	} battery;
+	struct {
+		int		valid;
+		char		path[STATUS_STRLEN];
+		int		percent;	/* used */
+		long long	free;		/* bytes available */
+	} fs[STATUS_FS_MAX];
+	struct {
+		int		valid;
+		double		temperature;	/* °C */
+		long long	fan;		/* rpm, -1 if unknown */
+	} thermal;
+	struct {
+		int		valid;
+		char		layout[STATUS_STRLEN];
+		int		caps;
+		int		num;
+	} keyboard;
+	struct status_brightness {
+		int		valid;
+		int		percent;
+	} brightness;
+	struct {
+		int		valid;
+		int		muted;
+		int		left;		/* percent */
+		int		right;		/* percent */
+	} audio;
+	struct status_weather {
+		int		valid;
+		double		temperature;
+		char		description[STATUS_STRLEN];
+	} weather;
+	struct {
+		int		valid;
+		long long	time;
+	} clock;
+};
+
+extern struct status status;
+extern const char *status_names[INFO_ARRAY_SIZE];
+
+int		status_element(const char *);
+const char     *status_json();
+
+#endif /* STATUS_H */
@@ -0,0 +1,100 @@
+/*
+ * system-bench -- measures the per tick cost of the system elements
+ *
+ * usage: system-bench [-n ticks]
+ *
+ * The CPU, memory and load elements of system.c are sampled through
+ * sysctl(2) ticks times and the time per tick is reported for each.
+ * This needs OpenBSD; proc-bench.c measures the /proc alternative.
+ * Exits with 1 if the kernel counters cannot be read.
+ */
+
+#include <sys/types.h>
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "status.h"
+#include "system.h"
+
+/* status.c is not linked, system.c only needs the variable */
+struct status status;
+
+static long long now();
+static void	report(const char *, int, long long);
+static void	usage();
+
+int
+main(int argc, char *argv[])
+{
+	const char *errstr;
+	long long start;
+	int ch, i, ticks;
+
+	ticks = 100000;
+
+	while ((ch = getopt(argc, argv, "n:")) != -1) {
+		switch (ch) {
+		case 'n':
+			ticks = strtonum(optarg, 1, 100000000, &errstr);
+			if (errstr != NULL)
+				errx(1, "ticks %s: %s", optarg, errstr);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	printf("%-14s %9s %9s\n", "case", "ticks", "ns/tick");
+
+	/* the first cpu sample only keeps the counters */
+	cpu_info();
+	start = now();
+	for (i = 0; i < ticks; i++)
+		cpu_info();
+	report("sysctl cpu", ticks, now() - start);
+
+	start = now();
+	for (i = 0; i < ticks; i++)
+		memory_info();
+	report("sysctl memory", ticks, now() - start);
+
+	start = now();
+	for (i = 0; i < ticks; i++)
+		load_info();
+	report("sysctl load", ticks, now() - start);
+
+	if (!status.memory.valid || !status.load.valid) {
+		printf("the kernel counters cannot be read\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+static long long
+now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void
+report(const char *name, int ticks, long long elapsed)
+{
+	printf("%-14s %9d %9lld\n", name, ticks,
+	    ticks > 0 ? elapsed / ticks : 0);
+}
+
+static void
+usage()
+{
+	fprintf(stderr, "usage: system-bench [-n ticks]\n");
+	exit(1);
+}
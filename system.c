@@ -0,0 +1,111 @@
+#include <sys/types.h>
+#include <sys/sched.h>
+#include <sys/sysctl.h>
+#include <uvm/uvmexp.h>
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "status.h"
+
+#define CPU_BUFLEN 10
+#define MEMORY_BUFLEN 12
+#define LOAD_BUFLEN 12
+
+/*
+ * The kernel exports the counters as binary structures through
+ * sysctl(2), so there is nothing to open or parse and every sample is
+ * a single system call into fixed buffers.
+ */
+
+char *
+cpu_info()
+{
+	static char str[CPU_BUFLEN];
+	static long last[CPUSTATES];
+	static int have_last = 0;
+	int mib[2] = { CTL_KERN, KERN_CPTIME };
+	long cur[CPUSTATES], total, idle;
+	size_t len;
+	int i;
+
+	status.cpu.valid = 0;
+
+	len = sizeof(cur);
+	if (sysctl(mib, 2, cur, &len, NULL, 0) == -1) {
+		warn("cannot get cpu times");
+		return NULL;
+	}
+
+	/* usage is only known from the difference of two samples */
+	if (!have_last) {
+		memcpy(last, cur, sizeof(last));
+		have_last = 1;
+		return NULL;
+	}
+
+	total = 0;
+	for (i = 0; i < CPUSTATES; i++)
+		total += cur[i] - last[i];
+	idle = cur[CP_IDLE] - last[CP_IDLE];
+	memcpy(last, cur, sizeof(last));
+
+	if (total <= 0)
+		return NULL;
+
+	status.cpu.valid = 1;
+	status.cpu.percent = (total - idle) * 100 / total;
+
+	snprintf(str, sizeof(str), "CPU %d%%", status.cpu.percent);
+	return str;
+}
+
+char *
+memory_info()
+{
+	static char str[MEMORY_BUFLEN];
+	int mib[2] = { CTL_VM, VM_UVMEXP };
+	struct uvmexp uvmexp;
+	size_t len;
+
+	status.memory.valid = 0;
+
+	len = sizeof(uvmexp);
+	if (sysctl(mib, 2, &uvmexp, &len, NULL, 0) == -1) {
+		warn("cannot get memory statistics");
+		return NULL;
+	}
+
+	status.memory.valid = 1;
+	status.memory.used = (long long)uvmexp.active * uvmexp.pagesize >> 20;
+	status.memory.total = (long long)uvmexp.npages * uvmexp.pagesize >> 20;
+
+	snprintf(str, sizeof(str), "MEM %lldM", status.memory.used);
+	return str;
+}
+
+char *
+load_info()
+{
+	static char str[LOAD_BUFLEN];
+	int mib[2] = { CTL_VM, VM_LOADAVG };
+	struct loadavg load;
+	size_t len;
+	int i;
+
+	status.load.valid = 0;
+
+	len = sizeof(load);
+	if (sysctl(mib, 2, &load, &len, NULL, 0) == -1) {
+		warn("cannot get load average");
+		return NULL;
+	}
+
+	status.load.valid = 1;
+	for (i = 0; i < 3; i++)
+		status.load.average[i] = (double)load.ldavg[i] / load.fscale;
+
+	snprintf(str, sizeof(str), "%.2f", status.load.average[0]);
+	return str;
+}
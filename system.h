@@ -0,0 +1,5 @@
+#define SYSTEM_INTERVAL (5 * 1000)
+
+char   *cpu_info();
+char   *memory_info();
+char   *load_info();
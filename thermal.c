@@ -0,0 +1,155 @@
+#include <sys/types.h>
+#include <sys/sensors.h>
+#include <sys/sysctl.h>
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "colors.h"
+#include "filter.h"
+#include "status.h"
+#include "thermal.h"
+
+#define THERMAL_BUFLEN 48
+
+/* Sensor device with the CPU package temperature, e.g. cpu0 or acpitz0 */
+#define THERMAL_DEVICE "cpu0"
+
+#define THERMAL_WARNING 80.0	/* °C, displayed in WARNING_COLOR */
+#define THERMAL_MARGIN 10.0	/* °C below the warning to sample fast */
+#define THERMAL_RISING 2.0	/* °C per sample considered a rising trend */
+
+#define THERMAL_SLOW_INTERVAL (30 * 1000)
+#define THERMAL_FAST_INTERVAL (2 * 1000)
+
+/* Whole degrees and hundreds of rpm, which are displayed for a while */
+#define THERMAL_HOLD (6 * 1000)
+static struct filter temp_filter = FILTER_INIT(1.0, 1.0, 0.0, THERMAL_HOLD);
+static struct filter fan_filter = FILTER_INIT(100.0, 150.0, 0.0,
+    THERMAL_HOLD);
+
+static int temp_mib[5] = { CTL_HW, HW_SENSORS, -1, SENSOR_TEMP, 0 };
+static int fan_mib[5] = { CTL_HW, HW_SENSORS, -1, SENSOR_FANRPM, 0 };
+static int initialized = 0;
+
+static int	thermal_read(int *, struct sensor *);
+
+/*
+ * Looks up the sensors once. Afterwards every sample is a single
+ * sysctl(2) per sensor. Returns 0 if there is no temperature sensor.
+ */
+int
+thermal_init()
+{
+	struct sensordev sd;
+	size_t len;
+	int mib[3] = { CTL_HW, HW_SENSORS, 0 };
+
+	if (initialized)
+		errx(1, "thermal_init called twice");
+
+	initialized = 1;
+
+	for (mib[2] = 0; ; mib[2]++) {
+		len = sizeof(sd);
+		if (sysctl(mib, 3, &sd, &len, NULL, 0) == -1) {
+			if (errno == ENXIO)
+				continue;
+			if (errno == ENOENT)
+				break;
+			warn("cannot get sensor device");
+			break;
+		}
+		if (temp_mib[2] == -1 && sd.maxnumt[SENSOR_TEMP] > 0 &&
+		    strcmp(sd.xname, THERMAL_DEVICE) == 0)
+			temp_mib[2] = sd.num;
+		if (fan_mib[2] == -1 && sd.maxnumt[SENSOR_FANRPM] > 0)
+			fan_mib[2] = sd.num;
+	}
+
+	if (temp_mib[2] == -1) {
+		warnx("no temperature sensor on " THERMAL_DEVICE);
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Samples slowly while the temperature is stable and far from the
+ * warning threshold, and fast when it is close to it or rising. The
+ * string and the status are only updated when the filtered values
+ * change.
+ */
+char *
+thermal_info(int *next_update)
+{
+	static char str[THERMAL_BUFLEN];
+	static double last = -1000.0;
+	struct sensor sensor;
+	double temp;
+	int n, changed;
+
+	status.thermal.valid = 0;
+
+	if (next_update)
+		*next_update = THERMAL_SLOW_INTERVAL;
+
+	if (!thermal_read(temp_mib, &sensor))
+		return NULL;
+
+	temp = (sensor.value - 273150000) / 1000000.0;
+
+	if (next_update && (temp >= THERMAL_WARNING - THERMAL_MARGIN ||
+	    temp - last >= THERMAL_RISING))
+		*next_update = THERMAL_FAST_INTERVAL;
+	last = temp;
+
+	changed = filter_update(&temp_filter, temp);
+	if (fan_mib[2] != -1 && thermal_read(fan_mib, &sensor))
+		changed |= filter_update(&fan_filter, sensor.value);
+	else if (fan_filter.valid) {
+		filter_reset(&fan_filter);
+		changed = 1;
+	}
+
+	/* a change held back is displayed at the end of the hold */
+	if (next_update) {
+		if ((n = filter_wait(&temp_filter)) != -1 && n < *next_update)
+			*next_update = n;
+		if ((n = filter_wait(&fan_filter)) != -1 && n < *next_update)
+			*next_update = n;
+	}
+
+	status.thermal.valid = 1;
+	status.thermal.temperature = temp_filter.value;
+	status.thermal.fan = fan_filter.valid ? fan_filter.value : -1;
+	if (!changed)
+		return str;
+
+	temp = temp_filter.value;
+	n = snprintf(str, sizeof(str), "%s%.0f °C%s",
+	    temp >= THERMAL_WARNING ? WARNING_COLOR : "", temp,
+	    temp >= THERMAL_WARNING ? NORMAL_COLOR : "");
+
+	if (fan_filter.valid)
+		snprintf(str + n, sizeof(str) - n, " %.0f rpm",
+		    fan_filter.value);
+
+	return str;
+}
+
+static int
+thermal_read(int *mib, struct sensor *sensor)
+{
+	size_t len;
+
+	len = sizeof(*sensor);
+	if (sysctl(mib, 5, sensor, &len, NULL, 0) == -1) {
+		warn("cannot read sensor");
+		return 0;
+	}
+
+	return !(sensor->flags & SENSOR_FINVALID);
+}
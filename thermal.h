@@ -0,0 +1,2 @@
+int     thermal_init();
+char   *thermal_info(int *);
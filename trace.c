@@ -0,0 +1,275 @@
+#include <sys/types.h>
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "status.h"
+#include "trace.h"
+
+#define TRACE_NULL UINT32_MAX	/* length of a missing element */
+
+#define TRACE_MAGIC "lbstrace"	/* without the terminating zero */
+#define TRACE_VERSION 1
+
+/*
+ * A trace starts with a file header, which identifies the format and
+ * the elements, so that a trace of another build is rejected. The
+ * start is kept there, so a recording continued after a re-exec keeps
+ * its timing.
+ */
+struct trace_file {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	infos;		/* INFO_ARRAY_SIZE */
+	int64_t		start;		/* CLOCK_MONOTONIC in nanoseconds */
+};
+
+/*
+ * It is followed by a sequence of fixed size headers, each followed by
+ * len bytes of data. Times are nanoseconds since the start of the
+ * recording.
+ */
+struct trace_header {
+	uint8_t		type;
+	uint8_t		index;		/* element of TRACE_SEGMENT */
+	int16_t		filter;		/* kevent filter of TRACE_EVENT */
+	uint32_t	len;
+	int64_t		time;
+	uint64_t	ident;		/* kevent ident or pipe byte */
+};
+
+static FILE *trace = NULL;
+static struct timespec start;
+static char recorded[INFO_ARRAY_SIZE][TRACE_SEGLEN];
+static int recorded_null[INFO_ARRAY_SIZE];
+
+static int64_t	trace_time();
+static const char *trace_check(const struct trace_file *);
+static void	trace_write(int, int, int, uint64_t, const char *, uint32_t);
+
+/*
+ * Opens a new recording at path. After a re-exec, resumed is set and a
+ * valid trace is continued instead, every element is then recorded
+ * again with the next frame.
+ */
+int
+trace_record_open(const char *path, int resumed)
+{
+	struct trace_file f;
+	const char *errstr;
+	int i;
+
+	if (resumed) {
+		if ((trace = fopen(path, "a+")) == NULL) {
+			warn("cannot open %s", path);
+			return 0;
+		}
+		errstr = "truncated";
+		if (fread(&f, sizeof(f), 1, trace) == 1 &&
+		    (errstr = trace_check(&f)) == NULL &&
+		    fseek(trace, 0, SEEK_END) == 0) {
+			start.tv_sec = f.start / 1000000000;
+			start.tv_nsec = f.start % 1000000000;
+			goto ready;
+		}
+		warnx("%s: %s, recording a new trace", path, errstr);
+		fclose(trace);
+	}
+
+	if ((trace = fopen(path, "w")) == NULL) {
+		warn("cannot open %s", path);
+		return 0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	memset(&f, 0, sizeof(f));
+	memcpy(f.magic, TRACE_MAGIC, sizeof(f.magic));
+	f.version = TRACE_VERSION;
+	f.infos = INFO_ARRAY_SIZE;
+	f.start = start.tv_sec * 1000000000LL + start.tv_nsec;
+	if (fwrite(&f, sizeof(f), 1, trace) != 1 || fflush(trace) == EOF) {
+		warn("cannot write %s", path);
+		fclose(trace);
+		trace = NULL;
+		return 0;
+	}
+
+ready:
+	for (i = 0; i < INFO_ARRAY_SIZE; i++)
+		recorded_null[i] = -1;	/* neither NULL nor a string yet */
+
+	return 1;
+}
+
+void
+trace_event(uintptr_t ident, int filter)
+{
+	if (trace != NULL)
+		trace_write(TRACE_EVENT, 0, filter, ident, NULL, 0);
+}
+
+/* The event byte read from the pipe of the X thread */
+void
+trace_byte(char c)
+{
+	if (trace != NULL)
+		trace_write(TRACE_BYTE, 0, 0, (unsigned char)c, NULL, 0);
+}
+
+/* Records the changed elements and the end of an event loop iteration. */
+void
+trace_frame(char *infos[])
+{
+	int i;
+
+	if (trace == NULL)
+		return;
+
+	for (i = 0; i < INFO_ARRAY_SIZE; i++) {
+		if (infos[i] == NULL) {
+			if (recorded_null[i] != 1)
+				trace_write(TRACE_SEGMENT, i, 0, 0, NULL,
+				    TRACE_NULL);
+			recorded_null[i] = 1;
+			continue;
+		}
+		if (recorded_null[i] == 0 &&
+		    strcmp(infos[i], recorded[i]) == 0)
+			continue;
+		strlcpy(recorded[i], infos[i], sizeof(recorded[i]));
+		recorded_null[i] = 0;
+		trace_write(TRACE_SEGMENT, i, 0, 0, recorded[i],
+		    strlen(recorded[i]));
+	}
+
+	trace_write(TRACE_FRAME, 0, 0, 0, NULL, 0);
+	fflush(trace);
+}
+
+/*
+ * Feeds a recorded trace through output. With a speed of 0 the frames
+ * follow each other immediately, otherwise the recorded timing is
+ * divided by speed. Returns the number of frames.
+ */
+int
+trace_replay(const char *path, double speed, char *infos[],
+    void (*output)(char **))
+{
+	static char segments[INFO_ARRAY_SIZE][TRACE_SEGLEN];
+	struct trace_file f;
+	struct trace_header h;
+	struct timespec ts;
+	const char *errstr;
+	FILE *fp;
+	int64_t due, elapsed;
+	int frames = 0, events = 0;
+
+	if ((fp = fopen(path, "r")) == NULL)
+		err(1, "cannot open %s", path);
+	if (fread(&f, sizeof(f), 1, fp) != 1)
+		errx(1, "%s: truncated", path);
+	if ((errstr = trace_check(&f)) != NULL)
+		errx(1, "%s: %s", path, errstr);
+
+	memset(infos, 0, INFO_ARRAY_SIZE * sizeof(char *));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (fread(&h, sizeof(h), 1, fp) == 1) {
+		switch (h.type) {
+		case TRACE_EVENT:
+		case TRACE_BYTE:
+			events++;
+			break;
+
+		case TRACE_SEGMENT:
+			if (h.index >= INFO_ARRAY_SIZE ||
+			    (h.len != TRACE_NULL && h.len >= TRACE_SEGLEN))
+				errx(1, "%s: invalid element", path);
+			if (h.len == TRACE_NULL) {
+				infos[h.index] = NULL;
+				break;
+			}
+			if (fread(segments[h.index], 1, h.len, fp) != h.len)
+				errx(1, "%s: truncated", path);
+			segments[h.index][h.len] = '\0';
+			infos[h.index] = segments[h.index];
+			break;
+
+		case TRACE_FRAME:
+			if (speed > 0) {
+				due = h.time / speed;
+				if ((elapsed = trace_time()) < due) {
+					ts.tv_sec = (due - elapsed) /
+					    1000000000;
+					ts.tv_nsec = (due - elapsed) %
+					    1000000000;
+					nanosleep(&ts, NULL);
+				}
+			}
+			output(infos);
+			frames++;
+			break;
+
+		default:
+			errx(1, "%s: unknown record type %d", path, h.type);
+		}
+	}
+
+	if (ferror(fp))
+		err(1, "cannot read %s", path);
+	fclose(fp);
+
+	fprintf(stderr, "%d events, %d frames in %.3f s\n", events, frames,
+	    trace_time() / 1e9);
+
+	return frames;
+}
+
+static int64_t
+trace_time()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start.tv_sec) * 1000000000LL +
+	    (now.tv_nsec - start.tv_nsec);
+}
+
+/* Returns why a file header does not fit this build, or NULL. */
+static const char *
+trace_check(const struct trace_file *f)
+{
+	if (memcmp(f->magic, TRACE_MAGIC, sizeof(f->magic)) != 0)
+		return "not a trace";
+	if (f->version != TRACE_VERSION)
+		return "unsupported trace version";
+	if (f->infos != INFO_ARRAY_SIZE)
+		return "recorded with other elements";
+
+	return NULL;
+}
+
+static void
+trace_write(int type, int index, int filter, uint64_t ident,
+    const char *data, uint32_t len)
+{
+	struct trace_header h;
+
+	memset(&h, 0, sizeof(h));
+	h.type = type;
+	h.index = index;
+	h.filter = filter;
+	h.len = len;
+	h.time = trace_time();
+	h.ident = ident;
+
+	if (fwrite(&h, sizeof(h), 1, trace) != 1 ||
+	    (data != NULL && fwrite(data, 1, len, trace) != len)) {
+		warn("cannot write trace, recording stopped");
+		fclose(trace);
+		trace = NULL;
+	}
+}
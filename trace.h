@@ -0,0 +1,9 @@
+#define TRACE_SEGLEN 512
+
+enum trace_types { TRACE_EVENT, TRACE_BYTE, TRACE_SEGMENT, TRACE_FRAME };
+
+int     trace_record_open(const char *, int);
+void    trace_event(uintptr_t, int);
+void    trace_byte(char);
+void    trace_frame(char **);
+int     trace_replay(const char *, double, char **, void (*)(char **));
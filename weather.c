@@ -1,83 +1,405 @@
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <fcntl.h>
 #include <err.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include <json-c/json.h>
 
-#define WEATHER_CURRENT_FILENAME "/home/wilfried/.cache/weather/current"
-#define WEATHER_TIMESTAMP_FILENAME "/home/wilfried/.cache/weather/timestamp"
+#include "config.h"
+#include "health.h"
+#include "http.h"
+#include "status.h"
+#include "weather.h"
+
+#define WEATHER_CURRENT_FILENAME "/current"	/* below the directory */
+#define WEATHER_TIMESTAMP_FILENAME "/timestamp"
 #define WEATHER_BUFLEN 48
+#define WEATHER_CACHE_PATH "/.cache/lemonbar-status/weather"	/* below $HOME */
+#define WEATHER_CACHE_MAGIC 0x6c627765	/* "lbwe" */
+#define WEATHER_CACHE_VERSION 1
+
+/*
+ * The parsed answer to the last request and its validators, kept on
+ * disk, so the element is shown at once after a restart and the next
+ * request may be answered with 304.
+ */
+static struct {
+	uint32_t	magic;
+	uint32_t	version;
+	int64_t		fetched;	/* s of the last answer */
+	char		url[CONFIG_URLLEN];
+	char		etag[HTTP_ETAGLEN];
+	char		last_modified[HTTP_DATELEN];
+	int		valid;
+	char		str[WEATHER_BUFLEN];
+	struct status_weather status;
+} cache;
+
+static char cache_path[PATH_MAX];
+static long long attempt;	/* s of the last request */
+
+static int	weather_parse(struct json_object *, char *, size_t,
+		    struct status_weather *);
+static int	weather_fetch_result(const struct http_response *);
+static void	weather_fetch_save();
 
 int weather_init() {
+	char path[PATH_MAX];
 	int fd;
 
-	fd = open(WEATHER_TIMESTAMP_FILENAME, O_RDONLY);
+	snprintf(path, sizeof(path), "%s" WEATHER_TIMESTAMP_FILENAME,
+	    config->weather);
+	fd = open(path, O_RDONLY);
 	if (fd < 0)
-		warn("cannot open " WEATHER_TIMESTAMP_FILENAME);
+		warn("cannot open %s", path);
+
+	return fd;
+}
+
+/*
+ * Opens the directory of the weather files. Its vnode is written when
+ * the weather script replaces the timestamp file by a rename, which
+ * the watch on the file itself does not survive.
+ */
+int
+weather_dir()
+{
+	int fd;
+
+	if ((fd = open(config->weather, O_RDONLY | O_DIRECTORY)) == -1)
+		warn("cannot open %s", config->weather);
 
 	return fd;
 }
 
+/*
+ * Opens the timestamp file again if it has been replaced or was
+ * missing. Returns 1 if *fd has been replaced; it is -1 if there is no
+ * file at the moment.
+ */
+int
+weather_reopen(int *fd)
+{
+	struct stat sb, fsb;
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s" WEATHER_TIMESTAMP_FILENAME,
+	    config->weather);
+	if (stat(path, &sb) == -1) {
+		if (*fd == -1)
+			return 0;
+		close(*fd);
+		*fd = -1;
+		return 1;
+	}
+
+	if (*fd >= 0) {
+		if (fstat(*fd, &fsb) == 0 && sb.st_dev == fsb.st_dev &&
+		    sb.st_ino == fsb.st_ino)
+			return 0;
+		close(*fd);
+	}
+
+	*fd = open(path, O_RDONLY);
+	return 1;
+}
+
 char *
 weather_info()
 {
-	static char str[WEATHER_BUFLEN], *strp, *ret;
-	struct json_object *obj, *new_obj, *iter_obj;
-	int i, len, buflen, n;
+	static char str[WEATHER_BUFLEN];
 
-	strp = str;
-	ret = NULL;
-	buflen = WEATHER_BUFLEN;
+	return weather_read(str, sizeof(str), &status.weather) ? str : NULL;
+}
+
+/*
+ * Parses the weather file into str and st, which may be a copy of the
+ * status member. Safe to call from a worker thread. Returns 1 on
+ * success.
+ */
+int
+weather_read(char *str, size_t buflen, void *arg)
+{
+	struct status_weather *st = arg;
+	const struct config *c;
+	struct json_object *obj;
+	char path[PATH_MAX];
+	int res;
 
-	if ((obj = json_object_from_file(WEATHER_CURRENT_FILENAME))
-	    == NULL) {
+	st->valid = 0;
+
+	c = atomic_load_explicit(&config, memory_order_acquire);
+	snprintf(path, sizeof(path), "%s" WEATHER_CURRENT_FILENAME,
+	    c->weather);
+	if ((obj = json_object_from_file(path)) == NULL) {
 		warnx("could not load JSON file");
-		goto cleanup_1;
+		return 0;
 	}
 
+	res = weather_parse(obj, str, buflen, st);
+	json_object_put(obj);
+	return res;
+}
+
+/*
+ * Formats the current weather of an OpenWeatherMap response into str
+ * and st. Returns 1 on success.
+ */
+static int
+weather_parse(struct json_object *obj, char *str, size_t buflen,
+    struct status_weather *st)
+{
+	struct json_object *new_obj, *iter_obj;
+	int i, len;
+	size_t n;
+
+	if (buflen > WEATHER_BUFLEN)
+		buflen = WEATHER_BUFLEN;
+	st->valid = 0;
+	st->description[0] = '\0';
+
 	if (!json_object_object_get_ex(obj, "main", &new_obj)) {
 		warnx("could not find 'main'");
-		goto cleanup_2;
+		return 0;
 	}
 	if (!json_object_object_get_ex(new_obj, "temp", &new_obj)) {
 		warnx("could not find 'main.temp'");
-		goto cleanup_2;
+		return 0;
 	}
-	n = snprintf(strp, buflen, "%.0f °C",
-	    json_object_get_double(new_obj));
+	st->temperature = json_object_get_double(new_obj);
+	snprintf(str, buflen, "%.0f °C", st->temperature);
 
 	if (!json_object_object_get_ex(obj, "weather", &new_obj)) {
 		warnx("could not find 'weather'");
-		goto cleanup_2;
+		return 0;
 	}
 	if (!json_object_is_type(new_obj, json_type_array)) {
 		warnx("'weather' is not an array");
-		goto cleanup_2;
+		return 0;
 	}
 	len = json_object_array_length(new_obj);
 	for (i = 0; i < len; i++) {
 		iter_obj = json_object_array_get_idx(new_obj, i);
 		if (!json_object_is_type(iter_obj, json_type_object)) {
 			warnx("weather[%d] is not an object", i);
-			goto cleanup_2;
+			return 0;
 		}
 		json_object_object_get_ex(iter_obj, "description",
 		    &iter_obj);
 		if (!json_object_is_type(iter_obj, json_type_string)) {
 			warnx("weather[%d].description is not a string", i);
-			goto cleanup_2;
+			return 0;
 		}
-		strp += n;
-		buflen -= n;
-		n = snprintf(strp, buflen, ", %s",
+		n = strlen(str);
+		snprintf(str + n, buflen - n, ", %s",
 		    json_object_get_string(iter_obj));
+		if (i > 0)
+			strlcat(st->description, ", ",
+			    sizeof(st->description));
+		strlcat(st->description, json_object_get_string(iter_obj),
+		    sizeof(st->description));
 	}
 
-	ret = str;
+	st->valid = 1;
+	return 1;
+}
+
+/*
+ * Prepares the built-in fetcher if a weather URL is configured, which
+ * replaces the files of the weather script. May be called again after
+ * the configuration has changed. The cache is only used if it belongs
+ * to the same URL. Returns 1 if the fetcher is used.
+ */
+int
+weather_fetch_init()
+{
+	char *home, *slash;
+	int fd;
 
-cleanup_2:
+	if (config->weather_url[0] == '\0')
+		return 0;
+
+	if (cache_path[0] == '\0' && (home = getenv("HOME")) != NULL) {
+		snprintf(cache_path, sizeof(cache_path),
+		    "%s" WEATHER_CACHE_PATH, home);
+		slash = strrchr(cache_path, '/');
+		*slash = '\0';
+		mkdir(cache_path, 0755);
+		*slash = '/';
+	}
+
+	memset(&cache, 0, sizeof(cache));
+	if (cache_path[0] != '\0' &&
+	    (fd = open(cache_path, O_RDONLY)) >= 0) {
+		if (read(fd, &cache, sizeof(cache)) != sizeof(cache) ||
+		    cache.magic != WEATHER_CACHE_MAGIC ||
+		    cache.version != WEATHER_CACHE_VERSION ||
+		    strcmp(cache.url, config->weather_url) != 0)
+			memset(&cache, 0, sizeof(cache));
+		close(fd);
+	}
+	attempt = cache.fetched;
+
+	return 1;
+}
+
+char *
+weather_fetch_info()
+{
+	if (!cache.valid) {
+		status.weather.valid = 0;
+		return NULL;
+	}
+
+	status.weather = cache.status;
+	return cache.str;
+}
+
+/*
+ * Returns the ms until the minimum refresh interval has passed and,
+ * after repeated failures, the backoff of the source has expired.
+ */
+int
+weather_fetch_delay()
+{
+	long long delay;
+	int backoff;
+
+	delay = (attempt - time(NULL)) * 1000 +
+	    config->intervals[INTERVAL_WEATHER];
+	if ((backoff = health_delay(HEALTH_WEATHER)) > delay)
+		delay = backoff;
+
+	return delay < 1 ? 1 : delay;
+}
+
+/*
+ * Starts a conditional request. Returns the descriptor to be watched
+ * for writing and reading or -1.
+ */
+int
+weather_fetch_start()
+{
+	int fd;
+
+	attempt = time(NULL);
+	if ((fd = http_get(config->weather_url, cache.etag,
+	    cache.last_modified)) == -1)
+		health_fail(HEALTH_WEATHER);
+
+	return fd;
+}
+
+/*
+ * Continues the request on *fd after an event of filter. Once it has
+ * finished, *fd is closed and the cache is updated. Returns HTTP_PENDING
+ * while the request is running, or HTTP_RETRY if it continues on a new
+ * descriptor in *fd.
+ */
+int
+weather_fetch_event(int *fd, int filter)
+{
+	int res;
+
+	if ((res = http_event(fd, filter)) == HTTP_PENDING ||
+	    res == HTTP_RETRY)
+		return res;
+
+	if (res == HTTP_DONE && !weather_fetch_result(http_response()))
+		res = HTTP_FAILED;
+	http_close(*fd);
+
+	if (res == HTTP_DONE)
+		health_ok(HEALTH_WEATHER);
+	else
+		health_fail(HEALTH_WEATHER);
+
+	return res;
+}
+
+/* Abandons a request which has not finished in time. */
+void
+weather_fetch_cancel(int fd)
+{
+	http_close(fd);
+	health_warnx(HEALTH_WEATHER, "weather request timed out");
+	health_fail(HEALTH_WEATHER);
+}
+
+/* Takes over a response. Returns 1 unless it is an error. */
+static int
+weather_fetch_result(const struct http_response *r)
+{
+	struct status_weather st;
+	struct json_object *obj;
+	char str[WEATHER_BUFLEN];
+	int res;
+
+	if (r->status == 304 && cache.valid) {
+		cache.fetched = time(NULL);
+		weather_fetch_save();
+		return 1;
+	}
+	if (r->status != 200) {
+		health_warnx(HEALTH_WEATHER, "weather request failed with "
+		    "status %d", r->status);
+		return 0;
+	}
+
+	if ((obj = json_tokener_parse(r->body)) == NULL) {
+		health_warnx(HEALTH_WEATHER, "invalid weather response");
+		return 0;
+	}
+	res = weather_parse(obj, str, sizeof(str), &st);
 	json_object_put(obj);
+	if (!res)
+		return 0;
+
+	strlcpy(cache.url, config->weather_url, sizeof(cache.url));
+	strlcpy(cache.etag, r->etag, sizeof(cache.etag));
+	strlcpy(cache.last_modified, r->last_modified,
+	    sizeof(cache.last_modified));
+	strlcpy(cache.str, str, sizeof(cache.str));
+	cache.status = st;
+	cache.valid = 1;
+	cache.fetched = time(NULL);
+	weather_fetch_save();
+
+	return 1;
+}
+
+/* Replaces the cache file, so a reader never sees a partial one. */
+static void
+weather_fetch_save()
+{
+	char tmp[PATH_MAX];
+	int fd;
+
+	if (cache_path[0] == '\0')
+		return;
+
+	cache.magic = WEATHER_CACHE_MAGIC;
+	cache.version = WEATHER_CACHE_VERSION;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", cache_path);
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+		warn("cannot open %s", tmp);
+		return;
+	}
+	if (write(fd, &cache, sizeof(cache)) != sizeof(cache)) {
+		warn("cannot write %s", tmp);
+		close(fd);
+		unlink(tmp);
+		return;
+	}
+	close(fd);
 
-cleanup_1:
-	return ret;
+	if (rename(tmp, cache_path) == -1)
+		warn("cannot rename %s", tmp);
 }
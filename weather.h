@@ -1,2 +1,13 @@
+#define WEATHER_INTERVAL (600 * 1000)	/* minimum between requests */
+
 int     weather_init();
+int     weather_dir();
+int     weather_reopen(int *);
 char   *weather_info();
+int     weather_read(char *, size_t, void *);
+int     weather_fetch_init();
+char   *weather_fetch_info();
+int     weather_fetch_delay();
+int     weather_fetch_start();
+int     weather_fetch_event(int *, int);
+void    weather_fetch_cancel(int);
@@ -0,0 +1,219 @@
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "worker.h"
+
+#define WORKER_STATUSLEN 256
+
+/*
+ * A slow information source. Its worker_fn runs on the pool and fills
+ * the buffers of the generation after gen, while the main thread only
+ * reads those of gen. A job is not started again before the main
+ * thread has collected the previous result, so the buffers of gen are
+ * never written while they are displayed.
+ */
+struct worker_job {
+	int		 info;
+	worker_fn	 fn;
+	void		*dst;		/* member of the status */
+	size_t		 size;
+
+	char		 str[2][WORKER_BUFLEN];
+	int		 valid[2];
+	union {
+		long double	 align;
+		unsigned char	 buf[WORKER_STATUSLEN];
+	}		 status[2];
+	atomic_uint	 gen;
+
+	/* only used by the main thread */
+	unsigned int	 seen;
+	int		 running;
+	int		 again;
+};
+
+static struct worker_job jobs[WORKER_MAX_JOBS];
+static int njobs = 0, threads = 0, notify_fd = -1, initialized = 0;
+
+/* jobs waiting for a thread, guarded by queue_mutex */
+static unsigned int queue = 0;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+static void    *worker_thread(void *);
+static void	worker_run(struct worker_job *);
+static void	worker_publish(struct worker_job *, char **);
+
+/*
+ * Starts the threads. Returns the descriptor which becomes readable
+ * when a job has finished, or -1 if jobs have to run synchronously.
+ */
+int
+worker_init()
+{
+	pthread_t thread;
+	int pipe_fd[2], i;
+
+	if (initialized)
+		errx(1, "worker_init called twice");
+
+	initialized = 1;
+
+	if (pipe2(pipe_fd, O_CLOEXEC) == -1) {
+		warn("cannot create worker pipe");
+		return -1;
+	}
+	if (fcntl(pipe_fd[0], F_SETFL, O_NONBLOCK) == -1) {
+		warn("cannot make worker pipe non-blocking");
+		goto cleanup_1;
+	}
+
+	notify_fd = pipe_fd[1];
+	for (i = 0; i < WORKER_THREADS; i++) {
+		if ((errno = pthread_create(&thread, NULL, worker_thread,
+		    NULL)) != 0) {
+			warn("cannot create worker thread");
+			break;
+		}
+		pthread_detach(thread);
+		threads++;
+	}
+
+	if (threads > 0)
+		return pipe_fd[0];
+
+	notify_fd = -1;
+
+cleanup_1:
+	close(pipe_fd[0]);
+	close(pipe_fd[1]);
+	return -1;
+}
+
+/*
+ * Registers a source of the element info. The status member dst of
+ * size bytes is updated from the copy filled by fn. Returns the id of
+ * the job.
+ */
+int
+worker_add(int info, worker_fn fn, void *dst, size_t size)
+{
+	struct worker_job *job;
+
+	if (njobs == WORKER_MAX_JOBS || size > WORKER_STATUSLEN)
+		errx(1, "cannot add worker job");
+
+	job = &jobs[njobs];
+	job->info = info;
+	job->fn = fn;
+	job->dst = dst;
+	job->size = size;
+
+	return njobs++;
+}
+
+/*
+ * Schedules a refresh. Without threads it is done at once and infos is
+ * updated; otherwise worker_collect() picks up the result.
+ */
+void
+worker_request(int id, char *infos[])
+{
+	struct worker_job *job = &jobs[id];
+
+	if (threads == 0) {
+		worker_run(job);
+		worker_publish(job, infos);
+		return;
+	}
+
+	if (job->running) {
+		job->again = 1;
+		return;
+	}
+	job->running = 1;
+
+	pthread_mutex_lock(&queue_mutex);
+	queue |= 1U << id;
+	pthread_cond_signal(&queue_cond);
+	pthread_mutex_unlock(&queue_mutex);
+}
+
+/* Takes over the results of all finished jobs. */
+void
+worker_collect(int fd, char *infos[])
+{
+	struct worker_job *job;
+	char buf[WORKER_MAX_JOBS];
+	int i;
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+
+	for (i = 0; i < njobs; i++) {
+		job = &jobs[i];
+		if (atomic_load_explicit(&job->gen, memory_order_acquire) ==
+		    job->seen)
+			continue;
+		worker_publish(job, infos);
+		job->running = 0;
+		if (job->again) {
+			job->again = 0;
+			worker_request(i, infos);
+		}
+	}
+}
+
+static void *
+worker_thread(void *arg)
+{
+	struct worker_job *job;
+	char c = 0;
+	int id;
+
+	(void)arg;
+
+	for (;;) {
+		pthread_mutex_lock(&queue_mutex);
+		while (queue == 0)
+			pthread_cond_wait(&queue_cond, &queue_mutex);
+		id = ffs(queue) - 1;
+		queue &= ~(1U << id);
+		pthread_mutex_unlock(&queue_mutex);
+
+		job = &jobs[id];
+		worker_run(job);
+		write(notify_fd, &c, 1);
+	}
+
+	return NULL;
+}
+
+/* Fills the buffers of the next generation and publishes them. */
+static void
+worker_run(struct worker_job *job)
+{
+	unsigned int next;
+
+	next = atomic_load_explicit(&job->gen, memory_order_relaxed) + 1;
+	job->valid[next & 1] = job->fn(job->str[next & 1],
+	    sizeof(job->str[0]), job->status[next & 1].buf);
+	atomic_store_explicit(&job->gen, next, memory_order_release);
+}
+
+static void
+worker_publish(struct worker_job *job, char *infos[])
+{
+	unsigned int gen;
+
+	gen = atomic_load_explicit(&job->gen, memory_order_acquire);
+	memcpy(job->dst, job->status[gen & 1].buf, job->size);
+	infos[job->info] = job->valid[gen & 1] ? job->str[gen & 1] : NULL;
+	job->seen = gen;
+}
@@ -0,0 +1,14 @@
+#define WORKER_THREADS 2
+#define WORKER_MAX_JOBS 8
+#define WORKER_BUFLEN 256
+
+/*
+ * Refreshes an element into str and its member of the status into the
+ * buffer given to worker_add(). Returns 1 if str is valid.
+ */
+typedef int (*worker_fn)(char *, size_t, void *);
+
+int     worker_init();
+int     worker_add(int, worker_fn, void *, size_t);
+void    worker_request(int, char **);
+void    worker_collect(int, char **);
@@ -1,18 +1,26 @@
 #include <xcb/xcb.h>
 #include <xcb/randr.h>
+#include <xcb/xkb.h>
 #include <err.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "config.h"
+#include "filter.h"
+#include "marquee.h"
+#include "status.h"
 #include "x.h"
 
 #define BRIGHTNESS_BUFLEN 5
-#define OUTPUT_NAME "eDP1"
-#define AUDIO_MUTE_KEYCODE 160
-#define AUDIO_DOWN_KEYCODE 174
-#define AUDIO_UP_KEYCODE 176
+#define KEYBOARD_BUFLEN 64
+#define KEYBOARD_GROUPS 4
+
+/* Changes reported to x_window_read() */
+#define WINDOW_ACTIVE 0x1
+#define WINDOW_NAME 0x2
 
 struct x_event_loop_args
 {
@@ -23,12 +31,41 @@ struct x_event_loop_args
 };
 
 static void   *x_event_loop_thread_start(struct x_event_loop_args *);
+static int	x_brightness_init(xcb_connection_t *);
+static int	x_output_find(xcb_connection_t *, const char *);
+static int	x_keyboard_init(xcb_connection_t *);
+static void	x_keyboard_event(xcb_generic_event_t *, int);
+static int	x_window_init(xcb_connection_t *, xcb_window_t);
+static void	x_window_title(xcb_window_t, char *, size_t);
+static void	x_window_event(xcb_property_notify_event_t *, xcb_window_t,
+		    int);
 
 static xcb_connection_t *display_connection;
 static xcb_window_t root_window;
 static xcb_atom_t backlight_atom_out;
-static xcb_randr_output_t output_out;
-static int range_out, randr_event_base, initialized = 0;
+static atomic_uint output_out;
+static atomic_int range_out;
+static int randr_event_base, brightness = 0, initialized = 0;
+
+/* Only read by the brightness job, a change below one percent is noise */
+static struct filter brightness_filter = FILTER_INIT(1.0, 1.0, 0.0, 0);
+
+/* The grabbed audio keycodes, compared by the event thread */
+static atomic_int keys[KEY_ARRAY_SIZE];
+
+/*
+ * The XKB group and locked modifiers, written by the event thread from
+ * the event payloads and read by x_keyboard_info(). The group names
+ * are only used by the main thread.
+ */
+static atomic_uint keyboard_state;
+static char group_names[KEYBOARD_GROUPS][STATUS_STRLEN];
+static int keyboard = 0, xkb_event_base;
+
+/* Atoms of the active window title and the pending changes */
+static xcb_atom_t active_window_atom, wm_name_atom, utf8_atom;
+static atomic_uint window_changes;
+static int window = 0;
 
 static pthread_t x_event_loop_thread;
 static struct x_event_loop_args bel_args;
@@ -50,6 +87,11 @@ static struct x_event_loop_args bel_args;
                                 brightness_range);
 */
 
+/*
+ * Connects to the display and starts the event thread. Returns 1 if
+ * the connection is kept, even if the brightness cannot be read
+ * through RandR, see x_brightness().
+ */
 int
 x_init(int pipe_fd)
 {
@@ -58,43 +100,88 @@ x_init(int pipe_fd)
 
         initialized = 1;
 
-	xcb_generic_error_t *error = NULL;
 	xcb_connection_t *conn = NULL;
-	const xcb_query_extension_reply_t *randr_data;
-	xcb_randr_query_version_reply_t *ver_reply = NULL;
-	xcb_intern_atom_reply_t *backlight_reply = NULL;
-	xcb_atom_t backlight_atom;
 	xcb_screen_t *screen = NULL;
 	xcb_screen_iterator_t iter;
-	xcb_randr_get_screen_resources_reply_t *resources_reply = NULL;
-	xcb_randr_output_t *outputs = NULL;
-	xcb_randr_get_output_info_reply_t *output_info_reply = NULL;
-	xcb_randr_query_output_property_reply_t *prop_query_reply = NULL;
-	int default_screen, i, res = 0;
-	int32_t *limits;
+	int default_screen, i;
 
 	conn = xcb_connect(NULL, &default_screen);
 	if (xcb_connection_has_error(conn)) {
 		warnx("cannot connect do display");
 		xcb_disconnect(conn);
-		conn = NULL;
-		goto cleanup_1;
+		return 0;
 	}
 	display_connection = conn;
 
+	iter = xcb_setup_roots_iterator(xcb_get_setup(conn));
+	i = default_screen;
+	for (; iter.rem; --i, xcb_screen_next(&iter))
+		if (i == 0)
+			screen = iter.data;
+	if (!screen) {
+		warnx("no screen found");
+		xcb_disconnect(conn);
+		return 0;
+	}
+	if (!screen->root) {
+		warnx("no root window found");
+		xcb_disconnect(conn);
+		return 0;
+	}
+	root_window = screen->root;
+
+	/* many outputs have no backlight, the rest works without it */
+	brightness = x_brightness_init(conn);
+	keyboard = x_keyboard_init(conn);
+	window = x_window_init(conn, root_window);
+
+        x_keys();
+
+        bel_args.conn = display_connection;
+        bel_args.root = root_window;
+        bel_args.event_base = randr_event_base;
+        bel_args.out = pipe_fd;
+
+        pthread_create(&x_event_loop_thread, NULL,
+            (void *(*)(void *))x_event_loop_thread_start,
+            &bel_args);
+
+	return 1;
+}
+
+/* Is the brightness read through RandR? */
+int
+x_brightness()
+{
+	return brightness;
+}
+
+/*
+ * Looks up the backlight property and the output of the configuration.
+ * Returns 1 if the brightness can be read through RandR.
+ */
+static int
+x_brightness_init(xcb_connection_t *conn)
+{
+	xcb_generic_error_t *error = NULL;
+	const xcb_query_extension_reply_t *randr_data;
+	xcb_randr_query_version_reply_t *ver_reply = NULL;
+	xcb_intern_atom_reply_t *backlight_reply = NULL;
+	int res = 0;
+
 	randr_data = xcb_get_extension_data(conn, &xcb_randr_id);
 	if (!randr_data->present) {
 		warnx("cannot find RandR extension");
-		goto cleanup_2;
+		goto cleanup_1;
 	}
 
-        randr_event_base = randr_data->first_event;
+	randr_event_base = randr_data->first_event;
 
 	ver_reply = xcb_randr_query_version_reply(conn,
 		xcb_randr_query_version(conn, 1, 2), &error);
 	if (error != NULL || ver_reply == NULL) {
 		warnx("cannot query RandR version");
-		goto cleanup_1;
+		goto cleanup_2;
 	}
 	if (ver_reply->major_version != 1 || ver_reply->minor_version < 2) {
 		warnx("RandR version %d.%d is too old",
@@ -109,34 +196,44 @@ x_init(int pipe_fd)
 		warnx("cannot intern backlight atom");
 		goto cleanup_2;
 	}
-        backlight_atom = backlight_reply->atom;
-
-	if (backlight_atom == XCB_NONE) {
+	if (backlight_reply->atom == XCB_NONE) {
 		warnx("no outputs have backlight property");
 		goto cleanup_3;
 	}
-	backlight_atom_out = backlight_atom;
+	backlight_atom_out = backlight_reply->atom;
 
-	iter = xcb_setup_roots_iterator(xcb_get_setup(conn));
-	i = default_screen;
-	for (; iter.rem; --i, xcb_screen_next(&iter))
-		if (i == 0)
-			screen = iter.data;
-	if (!screen) {
-		warnx("no screen found");
-		goto cleanup_3;
-	}
-	if (!screen->root) {
-		warnx("no root window found");
-		goto cleanup_3;
-	}
-	root_window = screen->root;
+	res = x_output_find(conn, config->output);
+
+cleanup_3:
+	free(backlight_reply);
+
+cleanup_2:
+	free(ver_reply);
+
+cleanup_1:
+	return res;
+}
+
+/*
+ * Looks up the RandR output name and the range of its backlight. The
+ * brightness is read from it from then on. Returns 1 on success.
+ */
+static int
+x_output_find(xcb_connection_t *conn, const char *name)
+{
+	xcb_generic_error_t *error = NULL;
+	xcb_randr_get_screen_resources_reply_t *resources_reply = NULL;
+	xcb_randr_output_t *outputs = NULL;
+	xcb_randr_get_output_info_reply_t *output_info_reply = NULL;
+	xcb_randr_query_output_property_reply_t *prop_query_reply = NULL;
+	int i, res = 0;
+	int32_t *limits;
 
 	resources_reply = xcb_randr_get_screen_resources_reply(conn,
 	    xcb_randr_get_screen_resources(conn, root_window), &error);
 	if (error != NULL || resources_reply == NULL) {
 		warnx("cannot get screen resources");
-		goto cleanup_3;
+		goto cleanup_1;
 	}
 
 	outputs = xcb_randr_get_screen_resources_outputs(resources_reply);
@@ -146,9 +243,9 @@ x_init(int pipe_fd)
 			    resources_reply->timestamp), &error);
 		if (error != NULL || output_info_reply == NULL) {
 			warnx("cannot get output name");
-			goto cleanup_4;
+			goto cleanup_2;
 		}
-		if (strncmp(OUTPUT_NAME,
+		if (strncmp(name,
 		    xcb_randr_get_output_info_name(output_info_reply),
 		    xcb_randr_get_output_info_name_length(output_info_reply))
 		    != 0) {
@@ -159,71 +256,107 @@ x_init(int pipe_fd)
 		break;
 	}
 	if (output_info_reply == NULL) {
-	    warn("RandR output " OUTPUT_NAME "not found");
-	    goto cleanup_4;
+	    warnx("RandR output %s not found", name);
+	    goto cleanup_2;
 	}
-	output_out = outputs[i];
 
 	prop_query_reply =
 	    xcb_randr_query_output_property_reply(conn,
 		xcb_randr_query_output_property(conn, outputs[i],
-		    backlight_atom), &error);
+		    backlight_atom_out), &error);
 	if (error != NULL || prop_query_reply == NULL) {
 		warnx("cannot query brightness limit propery");
-		goto cleanup_4;
+		goto cleanup_3;
 	}
 	if (prop_query_reply->range == 0 ||
 	    xcb_randr_query_output_property_valid_values_length(
 		prop_query_reply) != 2) {
 		warnx("could not get brightness min and max values");
-		goto cleanup_5;
+		goto cleanup_4;
 	}
 	limits = xcb_randr_query_output_property_valid_values(
 	    prop_query_reply);
-	range_out = limits[1] - limits[0];
+	atomic_store(&range_out, limits[1] - limits[0]);
+	atomic_store(&output_out, outputs[i]);
 
 	res = 1;
 
-        bel_args.conn = display_connection;
-        bel_args.root = root_window;
-        bel_args.event_base = randr_event_base;
-        bel_args.out = pipe_fd;
-
-        pthread_create(&x_event_loop_thread, NULL,
-            (void *(*)(void *))x_event_loop_thread_start,
-            &bel_args);
-
-cleanup_5:
-	free(prop_query_reply);
-	
 cleanup_4:
-	free(resources_reply);
+	free(prop_query_reply);
 
 cleanup_3:
-	free(backlight_reply);
+	free(output_info_reply);
 
 cleanup_2:
-	free(ver_reply);
+	free(resources_reply);
 
 cleanup_1:
-	if (!res)
-		xcb_disconnect(conn);
 	return res;
 }
 
+/*
+ * Switches to the output of a changed configuration. The connection
+ * and the grabs are kept. Returns 1 on success.
+ */
+int
+x_output()
+{
+	return x_output_find(display_connection, config->output);
+}
+
+/*
+ * Grabs the audio keys of the configuration, releasing the previous
+ * ones. The event thread compares the keycodes, so the keys may be
+ * replaced while it is running.
+ */
+void
+x_keys()
+{
+	int i, old;
+
+	for (i = 0; i < KEY_ARRAY_SIZE; i++) {
+		old = atomic_exchange(&keys[i], config->keys[i]);
+		if (old == config->keys[i])
+			continue;
+		if (old != 0)
+			xcb_ungrab_key(display_connection, old, root_window,
+			    XCB_MOD_MASK_ANY);
+		xcb_grab_key(display_connection, 1, root_window,
+		    XCB_MOD_MASK_ANY, config->keys[i], XCB_GRAB_MODE_ASYNC,
+		    XCB_GRAB_MODE_ASYNC);
+	}
+
+	xcb_flush(display_connection);
+}
 
 char *
 x_info()
 {
     	static char str[BRIGHTNESS_BUFLEN];
+
+	return x_read(str, sizeof(str), &status.brightness) ? str : NULL;
+}
+
+/*
+ * Fetches the brightness into str and st, which may be a copy of the
+ * status member. The X round trip may be done on a worker thread.
+ * Returns 1 on success.
+ */
+int
+x_read(char *str, size_t len, void *arg)
+{
+	struct status_brightness *st = arg;
 	xcb_generic_error_t *error = NULL;
 	xcb_randr_get_output_property_reply_t *prop_reply = NULL;
-	char *res = NULL;
-	int cur;
+	double percent;
+	int cur, res = 0;
+
+	st->valid = 0;
 
 	prop_reply = xcb_randr_get_output_property_reply(display_connection,
-	    xcb_randr_get_output_property(display_connection, output_out,
-                backlight_atom_out, XCB_ATOM_NONE, 0, 4, 0, 0),
+	    xcb_randr_get_output_property(display_connection,
+		atomic_load(&output_out), backlight_atom_out, XCB_ATOM_NONE,
+		0, 4, 0, 0),
 	    &error);
 	if (error != NULL || prop_reply == NULL) {
 	    warnx("cannot get output backlight property");
@@ -238,8 +371,12 @@ x_info()
 	cur = *((int32_t *)
 	    xcb_randr_get_output_property_data(prop_reply));
 
-	snprintf(str, sizeof(str), "%d%%", cur * 100 / range_out);
-	res = str;
+	st->valid = 1;
+	percent = cur * 100.0 / atomic_load(&range_out);
+	filter_update(&brightness_filter, percent);
+	st->percent = brightness_filter.value;
+	snprintf(str, len, "%.0f%%", brightness_filter.value);
+	res = 1;
 
 cleanup_2:
 	free(prop_reply);
@@ -248,35 +385,402 @@ cleanup_1:
 	return res;
 }
 
+/*
+ * Selects the XKB events which report changes of the group, the locked
+ * modifiers and the keymap. Returns 1 if the extension is available.
+ */
+static int
+x_keyboard_init(xcb_connection_t *conn)
+{
+	const xcb_query_extension_reply_t *xkb_data;
+	xcb_xkb_use_extension_reply_t *use_reply;
+	xcb_xkb_get_state_reply_t *state_reply;
+	xcb_generic_error_t *error = NULL;
+	uint16_t events;
+
+	xkb_data = xcb_get_extension_data(conn, &xcb_xkb_id);
+	if (!xkb_data->present) {
+		warnx("cannot find XKB extension");
+		return 0;
+	}
+	xkb_event_base = xkb_data->first_event;
+
+	use_reply = xcb_xkb_use_extension_reply(conn,
+	    xcb_xkb_use_extension(conn, XCB_XKB_MAJOR_VERSION,
+	    XCB_XKB_MINOR_VERSION), &error);
+	if (error != NULL || use_reply == NULL || !use_reply->supported) {
+		warnx("cannot use XKB extension");
+		free(use_reply);
+		return 0;
+	}
+	free(use_reply);
+
+	events = XCB_XKB_EVENT_TYPE_STATE_NOTIFY |
+	    XCB_XKB_EVENT_TYPE_NAMES_NOTIFY |
+	    XCB_XKB_EVENT_TYPE_NEW_KEYBOARD_NOTIFY;
+	xcb_xkb_select_events(conn, XCB_XKB_ID_USE_CORE_KBD, events, 0,
+	    events, 0, 0, NULL);
+
+	state_reply = xcb_xkb_get_state_reply(conn,
+	    xcb_xkb_get_state(conn, XCB_XKB_ID_USE_CORE_KBD), &error);
+	if (error != NULL || state_reply == NULL) {
+		warnx("cannot get keyboard state");
+		free(state_reply);
+		return 0;
+	}
+	atomic_store(&keyboard_state,
+	    state_reply->group | state_reply->lockedMods << 8);
+	free(state_reply);
+
+	keyboard = 1;
+	x_keyboard_names();
+
+	return 1;
+}
+
+/*
+ * Fetches the names of the keyboard groups. The atom names are
+ * requested all at once. Called once per keymap change.
+ */
+void
+x_keyboard_names()
+{
+	xcb_xkb_get_names_reply_t *names_reply;
+	xcb_xkb_get_names_value_list_t list;
+	xcb_get_atom_name_cookie_t cookies[KEYBOARD_GROUPS];
+	xcb_get_atom_name_reply_t *atom_reply;
+	xcb_generic_error_t *error = NULL;
+	int i, n;
+
+	if (!keyboard)
+		return;
+
+	for (i = 0; i < KEYBOARD_GROUPS; i++)
+		group_names[i][0] = '\0';
+
+	names_reply = xcb_xkb_get_names_reply(display_connection,
+	    xcb_xkb_get_names(display_connection, XCB_XKB_ID_USE_CORE_KBD,
+	    XCB_XKB_NAME_DETAIL_GROUP_NAMES), &error);
+	if (error != NULL || names_reply == NULL) {
+		warnx("cannot get keyboard group names");
+		free(names_reply);
+		return;
+	}
+
+	xcb_xkb_get_names_value_list_unpack(
+	    xcb_xkb_get_names_value_list(names_reply), names_reply->nTypes,
+	    names_reply->indicators, names_reply->virtualMods,
+	    names_reply->groupNames, names_reply->nKeys,
+	    names_reply->nKeyAliases, names_reply->nRadioGroups,
+	    names_reply->which, &list);
+	n = xcb_xkb_get_names_value_list_groups_length(names_reply, &list);
+	if (n > KEYBOARD_GROUPS)
+		n = KEYBOARD_GROUPS;
+
+	for (i = 0; i < n; i++)
+		cookies[i] = xcb_get_atom_name(display_connection,
+		    list.groups[i]);
+	for (i = 0; i < n; i++) {
+		atom_reply = xcb_get_atom_name_reply(display_connection,
+		    cookies[i], NULL);
+		if (atom_reply == NULL)
+			continue;
+		snprintf(group_names[i], sizeof(group_names[i]), "%.*s",
+		    xcb_get_atom_name_name_length(atom_reply),
+		    xcb_get_atom_name_name(atom_reply));
+		free(atom_reply);
+	}
+
+	free(names_reply);
+}
+
+char *
+x_keyboard_info()
+{
+	static char str[KEYBOARD_BUFLEN];
+	unsigned int state, group, locked;
+
+	status.keyboard.valid = 0;
+
+	if (!keyboard)
+		return NULL;
+
+	state = atomic_load(&keyboard_state);
+	group = state & 0xff;
+	locked = state >> 8;
+
+	status.keyboard.valid = 1;
+	strlcpy(status.keyboard.layout, group < KEYBOARD_GROUPS &&
+	    group_names[group][0] != '\0' ? group_names[group] : "?",
+	    sizeof(status.keyboard.layout));
+	status.keyboard.caps = (locked & XCB_MOD_MASK_LOCK) != 0;
+	status.keyboard.num = (locked & XCB_MOD_MASK_2) != 0;
+
+	snprintf(str, sizeof(str), "%s%s%s", status.keyboard.layout,
+	    status.keyboard.caps ? " CAPS" : "",
+	    status.keyboard.num ? " NUM" : "");
+
+	return str;
+}
+
+/*
+ * Handles an XKB event in the event thread. A state change is only
+ * passed on if the group or the locked modifiers differ, so pressing
+ * Shift does not wake up the main loop.
+ */
+static void
+x_keyboard_event(xcb_generic_event_t *evt, int out)
+{
+	xcb_xkb_state_notify_event_t *state;
+	unsigned int old, new;
+	char event;
+
+	/* all XKB events share the layout of the first bytes */
+	state = (xcb_xkb_state_notify_event_t *)evt;
+
+	switch (state->xkbType) {
+	case XCB_XKB_STATE_NOTIFY:
+		new = state->group | state->lockedMods << 8;
+		old = atomic_exchange(&keyboard_state, new);
+		if (old == new)
+			return;
+		event = (char)KEYBOARD_EVENT;
+		break;
+	case XCB_XKB_NAMES_NOTIFY:
+	case XCB_XKB_NEW_KEYBOARD_NOTIFY:
+		event = (char)KEYMAP_EVENT;
+		break;
+	default:
+		return;
+	}
+
+	write(out, &event, 1);
+}
+
+/*
+ * Interns the atoms of the window manager hints with pipelined
+ * requests and selects property changes on the root window. Returns 1
+ * if the window manager supports _NET_ACTIVE_WINDOW.
+ */
+static int
+x_window_init(xcb_connection_t *conn, xcb_window_t root)
+{
+	static const char *names[] = { "_NET_ACTIVE_WINDOW", "_NET_WM_NAME",
+	    "UTF8_STRING" };
+	xcb_atom_t *atoms[] = { &active_window_atom, &wm_name_atom,
+	    &utf8_atom };
+	xcb_intern_atom_cookie_t cookies[3];
+	xcb_intern_atom_reply_t *reply;
+	uint32_t mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+	int i, res = 1;
+
+	for (i = 0; i < 3; i++)
+		cookies[i] = xcb_intern_atom(conn, i == 0, strlen(names[i]),
+		    names[i]);
+	for (i = 0; i < 3; i++) {
+		reply = xcb_intern_atom_reply(conn, cookies[i], NULL);
+		if (reply == NULL || reply->atom == XCB_NONE) {
+			warnx("cannot intern %s atom", names[i]);
+			res = 0;
+		} else
+			*atoms[i] = reply->atom;
+		free(reply);
+	}
+	if (!res)
+		return 0;
+
+	xcb_change_window_attributes(conn, root, XCB_CW_EVENT_MASK, &mask);
+	atomic_store(&window_changes, WINDOW_ACTIVE);
+
+	return 1;
+}
+
+char *
+x_window_info()
+{
+	static char str[STATUS_STRLEN];
+
+	return x_window_read(str, sizeof(str), &status.window) ? str : NULL;
+}
+
+/*
+ * Fetches the title of the active window into str and st, which may be
+ * a copy of the status member. The active window is only looked up
+ * after _NET_ACTIVE_WINDOW has changed and the title only after the
+ * window or its name has changed; otherwise the cached title is used.
+ * Must not run concurrently with itself. Returns 1 if a title is set.
+ */
+int
+x_window_read(char *str, size_t len, void *arg)
+{
+	static xcb_window_t active = XCB_NONE;
+	static char title[STATUS_STRLEN];
+	struct status_window *st = arg;
+	xcb_get_property_reply_t *reply;
+	xcb_window_t win;
+	uint32_t mask;
+	unsigned int changes;
+
+	st->valid = 0;
+
+	if (!window)
+		return 0;
+
+	changes = atomic_exchange(&window_changes, 0);
+
+	if (changes & WINDOW_ACTIVE) {
+		win = XCB_NONE;
+		reply = xcb_get_property_reply(display_connection,
+		    xcb_get_property(display_connection, 0, root_window,
+		    active_window_atom, XCB_ATOM_WINDOW, 0, 1), NULL);
+		if (reply != NULL && reply->type == XCB_ATOM_WINDOW &&
+		    xcb_get_property_value_length(reply) ==
+		    sizeof(xcb_window_t))
+			win = *(xcb_window_t *)xcb_get_property_value(reply);
+		free(reply);
+
+		if (win != active) {
+			/* only the name of the active window is watched */
+			mask = XCB_EVENT_MASK_NO_EVENT;
+			if (active != XCB_NONE)
+				xcb_change_window_attributes(
+				    display_connection, active,
+				    XCB_CW_EVENT_MASK, &mask);
+			mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+			if (win != XCB_NONE)
+				xcb_change_window_attributes(
+				    display_connection, win,
+				    XCB_CW_EVENT_MASK, &mask);
+			xcb_flush(display_connection);
+			active = win;
+			changes |= WINDOW_NAME;
+		}
+	}
+
+	if (changes & WINDOW_NAME) {
+		title[0] = '\0';
+		if (active != XCB_NONE)
+			x_window_title(active, title, sizeof(title));
+	}
+
+	if (title[0] == '\0')
+		return 0;
+
+	st->valid = 1;
+	strlcpy(st->title, title, sizeof(st->title));
+	strlcpy(str, title, len);
+
+	return 1;
+}
+
+/*
+ * Reads _NET_WM_NAME, or WM_NAME if it is not set. Percent signs are
+ * doubled, so lemonbar does not take them for formatting tags.
+ */
+static void
+x_window_title(xcb_window_t win, char *title, size_t len)
+{
+	xcb_get_property_cookie_t net_cookie, icccm_cookie;
+	xcb_get_property_reply_t *net_reply, *icccm_reply, *reply;
+	const char *value;
+	size_t i, n;
+	int vlen;
+
+	/* request both names at once */
+	net_cookie = xcb_get_property(display_connection, 0, win,
+	    wm_name_atom, utf8_atom, 0, STATUS_STRLEN / 4);
+	icccm_cookie = xcb_get_property(display_connection, 0, win,
+	    XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 0, STATUS_STRLEN / 4);
+	net_reply = xcb_get_property_reply(display_connection, net_cookie,
+	    NULL);
+	icccm_reply = xcb_get_property_reply(display_connection,
+	    icccm_cookie, NULL);
+
+	reply = net_reply != NULL &&
+	    xcb_get_property_value_length(net_reply) > 0 ?
+	    net_reply : icccm_reply;
+	if (reply != NULL) {
+		value = xcb_get_property_value(reply);
+		vlen = xcb_get_property_value_length(reply);
+		for (i = 0, n = 0; i < (size_t)vlen && n + 2 < len; i++) {
+			if (value[i] == '%')
+				title[n++] = '%';
+			title[n++] = value[i];
+		}
+		title[n] = '\0';
+		marquee_trim(title);
+	}
+
+	free(net_reply);
+	free(icccm_reply);
+}
+
+/* Called by the event thread for property changes. */
+static void
+x_window_event(xcb_property_notify_event_t *evt, xcb_window_t root,
+    int out)
+{
+	char event = (char)WINDOW_EVENT;
+	unsigned int change;
+
+	if (evt->window == root && evt->atom == active_window_atom)
+		change = WINDOW_ACTIVE;
+	else if (evt->window != root && (evt->atom == wm_name_atom ||
+	    evt->atom == XCB_ATOM_WM_NAME))
+		change = WINDOW_NAME;
+	else
+		return;
+
+	/* the main loop is woken up once until the title was fetched */
+	if (atomic_fetch_or(&window_changes, change) == 0)
+		write(out, &event, 1);
+}
+
 void
 x_event_loop(xcb_connection_t *conn, xcb_window_t root,
 	int randr_event_base, int out)
 {
 	xcb_generic_event_t *evt;
+	xcb_key_press_event_t *key;
+	xcb_timestamp_t last_release = XCB_CURRENT_TIME;
 	char brightness_event = (char)BRIGHTNESS_EVENT;
-	char audio_event = (char)AUDIO_EVENT; 
-
-	xcb_randr_select_input(conn, root,
-	    XCB_RANDR_NOTIFY_MASK_OUTPUT_PROPERTY |
-	    XCB_RANDR_NOTIFY_MASK_OUTPUT_CHANGE);
+	char audio_event;
 
-	xcb_grab_key(conn, 1, root, XCB_MOD_MASK_ANY, AUDIO_MUTE_KEYCODE,
-	    XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
-	xcb_grab_key(conn, 1, root, XCB_MOD_MASK_ANY, AUDIO_DOWN_KEYCODE,
-	    XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
-	xcb_grab_key(conn, 1, root, XCB_MOD_MASK_ANY, AUDIO_UP_KEYCODE,
-	    XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+	if (brightness)
+		xcb_randr_select_input(conn, root,
+		    XCB_RANDR_NOTIFY_MASK_OUTPUT_PROPERTY |
+		    XCB_RANDR_NOTIFY_MASK_OUTPUT_CHANGE);
 
 	xcb_flush(conn);
 
 	while ((evt = xcb_wait_for_event(conn)) != NULL) {
-		if (evt->response_type == randr_event_base +
+		if (brightness && evt->response_type == randr_event_base +
 		    XCB_RANDR_NOTIFY_OUTPUT_CHANGE) {
 			write(out, &brightness_event, 1);
                 }
-		else if (evt->response_type == XCB_KEY_RELEASE) {
-			write(out, &audio_event, 1);
-                }
+		else if (keyboard && evt->response_type == xkb_event_base)
+			x_keyboard_event(evt, out);
+		else if (window && evt->response_type == XCB_PROPERTY_NOTIFY)
+			x_window_event((xcb_property_notify_event_t *)evt,
+			    root, out);
+		else if (evt->response_type == XCB_KEY_PRESS) {
+			key = (xcb_key_press_event_t *)evt;
+			if (key->detail == atomic_load(&keys[KEY_MUTE])) {
+				/* an auto-repeat must not toggle again */
+				audio_event = (char)AUDIO_MUTE_EVENT;
+				if (key->time != last_release)
+					write(out, &audio_event, 1);
+			} else if (key->detail ==
+			    atomic_load(&keys[KEY_DOWN])) {
+				audio_event = (char)AUDIO_DOWN_EVENT;
+				write(out, &audio_event, 1);
+			} else if (key->detail == atomic_load(&keys[KEY_UP])) {
+				audio_event = (char)AUDIO_UP_EVENT;
+				write(out, &audio_event, 1);
+			}
+		} else if (evt->response_type == XCB_KEY_RELEASE)
+			last_release =
+			    ((xcb_key_release_event_t *)evt)->time;
 		free(evt);
 	}
 }
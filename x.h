@@ -1,6 +1,16 @@
 #define BRIGHTNESS_INTERVAL (10 * 1000)
+#define WINDOW_DELAY 50		/* ms to coalesce focus changes */
 
-enum x_events { BRIGHTNESS_EVENT, AUDIO_EVENT };
+enum x_events { BRIGHTNESS_EVENT, AUDIO_MUTE_EVENT, AUDIO_DOWN_EVENT,
+    AUDIO_UP_EVENT, KEYBOARD_EVENT, KEYMAP_EVENT, WINDOW_EVENT };
 
 int     x_init(int);
+int     x_brightness();
+int     x_output();
+void    x_keys();
 char   *x_info();
+int     x_read(char *, size_t, void *);
+char   *x_keyboard_info();
+void    x_keyboard_names();
+char   *x_window_info();
+int     x_window_read(char *, size_t, void *);